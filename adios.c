@@ -9,20 +9,28 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/compiler.h>
+#include <linux/debugfs.h>
 #include <linux/fs.h>
+#include <linux/hrtimer.h>
 #include <linux/init.h>
+#include <linux/int_sqrt.h>
+#include <linux/ioprio.h>
 #include <linux/kernel.h>
 #include <linux/math.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/rbtree.h>
 #include <linux/sbitmap.h>
 #include <linux/slab.h>
+#include <linux/string.h>
 #include <linux/timekeeping.h>
+#include <linux/workqueue.h>
 
 #include "include/elevator.h"
 #include "include/blk.h"
 #include "include/blk-mq.h"
 #include "include/blk-mq-sched.h"
+#include "adios.h"
 
 #define ADIOS_VERSION "1.5.3"
 
@@ -45,6 +53,26 @@ static u32 default_lm_shrink_at_kreqs  = 10000;
 static u32 default_lm_shrink_at_gbytes =   100;
 static u32 default_lm_shrink_resist    =     2;
 
+// Use a provisional estimate from early samples while a model has no base
+static bool default_lat_bootstrap = true;
+
+// Safety margin added to predictions, in hundredths of a standard deviation
+static u32 default_lat_sigma_k = 0;
+
+// In-flight share of the window below which idle inserts skip batching (0: off)
+static u8  default_fast_path_ratio = 0;
+
+// Write release interval as a percentage of predicted write latency (0: off)
+static u32 default_write_pacing = 0;
+
+// Time async writes wait to collect merges before batching, in ns (0: off)
+static u64 default_write_merge_delay = 0;
+#define ADIOS_WRITE_MERGE_DELAY_MAX (10ULL * NSEC_PER_MSEC)
+
+// Time async writes ending inside an optimal I/O unit wait for it to fill (0: off)
+static u64 default_write_align_hold = 0;
+#define ADIOS_WRITE_ALIGN_HOLD_MAX (1000ULL * NSEC_PER_MSEC)
+
 // Latency targets for each operation type
 static u64 default_latency_target[ADIOS_OPTYPES] = {
 	[ADIOS_READ]    =     1ULL * NSEC_PER_MSEC,
@@ -58,9 +86,47 @@ static u32 default_batch_limit[ADIOS_OPTYPES] = {
 	[ADIOS_READ]    = 24,
 	[ADIOS_WRITE]   = 48,
 	[ADIOS_DISCARD] =  1,
-	[ADIOS_OTHER]   =  1,
+	[ADIOS_OTHER]   =  8,
+};
+
+// Per-optype in-flight latency budgets (0 means only the global window applies)
+static u64 default_latency_window[ADIOS_OPTYPES] = {
+	[ADIOS_READ]    = 0ULL,
+	[ADIOS_WRITE]   = 0ULL,
+	[ADIOS_DISCARD] = 0ULL,
+	[ADIOS_OTHER]   = 0ULL,
 };
 
+// Per-optype predicted backlog above which REQ_NOWAIT I/O fails (0: off)
+static u64 default_nowait_backlog[ADIOS_OPTYPES] = {
+	[ADIOS_READ]    = 0ULL,
+	[ADIOS_WRITE]   = 0ULL,
+	[ADIOS_DISCARD] = 0ULL,
+	[ADIOS_OTHER]   = 0ULL,
+};
+
+// Per-optype predicted backlog above which submitters are throttled (0: off)
+static u64 default_throttle_backlog[ADIOS_OPTYPES] = {
+	[ADIOS_READ]    = 0ULL,
+	[ADIOS_WRITE]   = 0ULL,
+	[ADIOS_DISCARD] = 0ULL,
+	[ADIOS_OTHER]   = 0ULL,
+};
+
+// Latency target for swap-in reads (0: treated like other reads)
+static u64 default_swap_target = 250ULL * NSEC_PER_USEC;
+// Priority of swap-in reads in read/write arbitration
+static s32 default_swap_prio = 12;
+
+// Partitions with their own targets, priority and statistics
+#define ADIOS_PARTS 16
+
+// Duration limit hint levels (IOPRIO_HINT_DEV_DURATION_LIMIT_1..7)
+#define ADIOS_CDL_LEVELS (IOPRIO_HINT_DEV_DURATION_LIMIT_7 + 1)
+
+// Latency targets for each duration limit hint level (0: hint ignored)
+static u64 default_cdl_target[ADIOS_CDL_LEVELS] = { 0 };
+
 static u32 default_dl_prio[2] = {
 	[0] = 7,
 	[1] = 0,
@@ -72,6 +138,11 @@ static u32 default_dl_prio[2] = {
 #define LM_INTERVAL_THRESHOLD   1500
 #define LM_OUTLIER_PERCENTILE     99
 #define LM_LAT_BUCKET_COUNT       64
+#define LM_VAR_EWMA_SHIFT          4
+#define LM_VAR_MAX_DEVIATION   (1ULL << 31)
+#define LM_GEN_CHANGE_PCT         25
+#define LM_BOOT_SAMPLES           64
+#define LM_BOOT_MIN_KIB            4
 
 // Structure to hold latency bucket data for small requests
 struct latency_bucket_small {
@@ -96,10 +167,24 @@ struct latency_model {
 	u64 large_sum_delay;
 	u64 large_sum_bsize;
 	u64 last_update_jiffies;
+	u64 stddev;
+
+	// Bumped whenever base or slope moves beyond LM_GEN_CHANGE_PCT
+	u32 gen;
+	u64 gen_base;
+	u64 gen_slope;
 
 	spinlock_t buckets_lock;
 	struct latency_bucket_small small_bucket[LM_LAT_BUCKET_COUNT];
 	struct latency_bucket_large large_bucket[LM_LAT_BUCKET_COUNT];
+	u64 variance;
+
+	// Provisional cost per KiB, learned from early samples while !base
+	bool bootstrap;
+	u64 boot_sum_lat;
+	u64 boot_sum_kib;
+	u32 boot_count;
+	u64 boot_lat_per_kib;
 
 	u32 lm_shrink_at_kreqs;
 	u32 lm_shrink_at_gbytes;
@@ -108,6 +193,68 @@ struct latency_model {
 
 #define ADIOS_BQ_PAGES 2
 
+// Batches tracked for measuring the effective device parallelism
+#define ADIOS_BATCH_TRACK   8
+#define PAR_ONE          1024
+#define PAR_MAX         (256 * PAR_ONE)
+#define PAR_EWMA_SHIFT      3
+
+// Makespan accounting of one filled batch
+struct adios_batch_stat {
+	// Batch sequence in the upper and pending requests in the lower 32 bits
+	atomic64_t state;
+	u64 start_ns;
+	u64 sum_lat;
+};
+#define BATCH_STAT_SEQ(state)     ((u32)((u64)(state) >> 32))
+#define BATCH_STAT_PENDING(state) ((u32)(state))
+
+// Batched requests scanned for one submitted through the dispatching hctx
+#define ADIOS_LOCALITY_SCAN 8
+
+// Queued requests of window-limited optypes scanned past during a fill
+#define ADIOS_MASKED_SCAN 32
+
+// Fallback delay before a throttled queue is re-run without a completion
+#define ADIOS_THROTTLE_RERUN_MS 10
+
+// Seed model shared by the ADIOS instances of identical devices
+#define ADIOS_GROUP_NAME_LEN 32
+struct adios_model_group {
+	struct list_head node;
+	char name[ADIOS_GROUP_NAME_LEN];
+	u32 refs;
+	u64 base[ADIOS_OPTYPES];
+	u64 slope[ADIOS_OPTYPES];
+};
+
+static LIST_HEAD(adios_model_groups);
+static DEFINE_SPINLOCK(adios_model_groups_lock);
+
+// Instances with latency samples waiting to be folded into their models
+static LIST_HEAD(adios_update_list);
+static DEFINE_SPINLOCK(adios_update_lock);
+static void adios_update_workfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(adios_update_work, adios_update_workfn);
+
+// Directory holding the per-queue latency predictor pages
+static struct dentry *adios_debugfs_root;
+
+// Per-partition overrides and statistics, indexed by partition number
+struct adios_part {
+	u64 latency_target[ADIOS_OPTYPES];
+	s32 prio;
+	bool prio_set;
+	atomic64_t count[ADIOS_OPTYPES];
+	atomic64_t sum_lat[ADIOS_OPTYPES];
+};
+
+// Write lifetime hints tracked for stream separation
+#define ADIOS_WRITE_HINTS (WRITE_LIFE_EXTREME + 1)
+#define WH_COST_ONE        1024
+#define WH_COST_MAX       (16 * WH_COST_ONE)
+#define WH_COST_EWMA_SHIFT   4
+
 // Adios scheduler data
 struct adios_data {
 	spinlock_t pq_lock;
@@ -116,27 +263,72 @@ struct adios_data {
 	struct rb_root_cached dl_tree[2];
 	spinlock_t lock;
 	u8  dl_queued;
+	// Held async writes parked outside the tree, by hold expiry
+	struct list_head held_rqs;
 	s64 dl_bias;
 	s32 dl_prio[2];
+	u64 queued_pred_lat[ADIOS_OPTYPES];
 
 	u64 global_latency_window;
+	u64 latency_window[ADIOS_OPTYPES];
+	u64 nowait_backlog[ADIOS_OPTYPES];
+	u64 throttle_backlog[ADIOS_OPTYPES];
 	u64 latency_target[ADIOS_OPTYPES];
+	u64 cdl_target[ADIOS_CDL_LEVELS];
+	u64 swap_target;
+	s32 swap_prio;
+	struct adios_part part[ADIOS_PARTS];
 	u32 batch_limit[ADIOS_OPTYPES];
 	u32 batch_actual_max_size[ADIOS_OPTYPES];
 	u32 batch_actual_max_total;
 	u32 async_depth;
 	u8  bq_refill_below_ratio;
+	u8  fast_path_ratio;
+	u32 lat_sigma_k;
+	bool least_laxity;
 
 	u8 bq_page;
 	bool more_bq_ready;
+	bool throttled;
+	u32 batch_seq;
+	struct adios_batch_stat batch_stat[ADIOS_BATCH_TRACK];
+	bool parallelism_scaling;
+	u32 parallelism;
 	struct list_head batch_queue[ADIOS_BQ_PAGES][ADIOS_OPTYPES];
 	u32 batch_count[ADIOS_BQ_PAGES][ADIOS_OPTYPES];
 	spinlock_t bq_lock;
 
+	bool write_hint_group;
+	bool write_hint_learn;
+	u32 write_hint_cost[ADIOS_WRITE_HINTS];
+
+	bool dispatch_locality;
+
+	u32 write_pacing;
+	u64 write_merge_delay;
+	u64 write_align_hold;
+	u64 next_write_ns;
+	struct hrtimer dispatch_timer;
+	struct request_queue *queue;
+
 	struct latency_model latency_model[ADIOS_OPTYPES];
-	struct timer_list update_timer;
+	struct list_head update_node;
+	struct adios_model_group *model_group;
 
 	atomic64_t total_pred_lat;
+	atomic64_t optype_pred_lat[ADIOS_OPTYPES];
+
+	// Latency predictor page shared read-only with userspace
+	struct page *info_page;
+	struct adios_info_page *info;
+	spinlock_t info_lock;
+	struct dentry *info_dentry;
+	// Open files of the page; a mapping holds its file open
+	atomic_t info_users;
+
+	atomic64_t swap_count;
+	atomic64_t swap_sum_lat;
+	atomic64_t swap_missed;
 
 	struct kmem_cache *rq_data_pool;
 	struct kmem_cache *dl_group_pool;
@@ -153,11 +345,20 @@ struct dl_group {
 struct adios_rq_data {
 	struct list_head *dl_group;
 	struct list_head dl_node;
+	// Ring of requests inserted together by one plug flush
+	struct list_head group_node;
 
 	struct request *rq;
 	u64 deadline;
 	u64 pred_lat;
+	u64 plan_lat;
 	u32 block_size;
+	u32 model_gen;
+	u32 batch_seq;
+	// Time a parked write's hold expires (0: not parked)
+	u64 hold_until;
+	// Target tightened by the swap class or a duration limit hint
+	bool urgent;
 } __attribute__((aligned(64)));
 
 static const int adios_prio_to_weight[40] = {
@@ -319,6 +520,20 @@ static bool lm_update_large_buckets(
 	return true;
 }
 
+// Whether a model parameter has moved far enough to invalidate predictions
+static bool lm_param_changed(u64 old, u64 new) {
+	u64 diff = old > new ? old - new : new - old;
+
+	return diff * 100 > old * LM_GEN_CHANGE_PCT;
+}
+
+// Start a new model generation, invalidating queued predictions
+static void lm_bump_gen(struct latency_model *model) {
+	model->gen_base = model->base;
+	model->gen_slope = model->slope;
+	WRITE_ONCE(model->gen, model->gen + 1);
+}
+
 // Update the latency model parameters and statistics
 static void latency_model_update(struct latency_model *model) {
 	unsigned long flags;
@@ -351,6 +566,9 @@ static void latency_model_update(struct latency_model *model) {
 		large_processed = lm_update_large_buckets(
 			model, large_count, !model->slope);
 
+	// Refresh the standard deviation from the tracked variance
+	model->stddev = int_sqrt64(model->variance);
+
 	spin_unlock_irqrestore(&model->buckets_lock, flags);
 
 	// Update the base parameter if small bucket was processed
@@ -362,6 +580,11 @@ static void latency_model_update(struct latency_model *model) {
 		model->slope = div_u64(model->large_sum_delay,
 			DIV_ROUND_UP_ULL(model->large_sum_bsize, 1024));
 
+	// Start a new generation if the model changed significantly
+	if (lm_param_changed(model->gen_base, model->base) ||
+			lm_param_changed(model->gen_slope, model->slope))
+		lm_bump_gen(model);
+
 	// Reset statistics and update last updated jiffies if time has elapsed
 	if (time_elapsed)
 		model->last_update_jiffies = now;
@@ -382,6 +605,62 @@ static u8 lm_input_bucket_index(
 	return bucket_index;
 }
 
+// Track the variance of the measured latency around the prediction
+static void lm_input_variance(
+		struct latency_model *model, u64 measured, u64 predicted) {
+	u64 deviation;
+
+	deviation = measured > predicted ?
+		measured - predicted : predicted - measured;
+	if (deviation > LM_VAR_MAX_DEVIATION)
+		deviation = LM_VAR_MAX_DEVIATION;
+
+	model->variance -= model->variance >> LM_VAR_EWMA_SHIFT;
+	model->variance += (deviation * deviation) >> LM_VAR_EWMA_SHIFT;
+}
+
+// Size of a request in KiB as counted by the bootstrap estimate
+static u64 lm_boot_kib(u32 block_size) {
+	return max_t(u64, DIV_ROUND_UP(block_size, 1024), LM_BOOT_MIN_KIB);
+}
+
+// Learn a conservative provisional estimate from samples taken while !base
+static void lm_input_bootstrap(
+		struct latency_model *model, u32 block_size, u64 latency) {
+	lockdep_assert_held(&model->buckets_lock);
+
+	if (model->boot_count >= LM_BOOT_SAMPLES) {
+		model->boot_sum_lat >>= 1;
+		model->boot_sum_kib >>= 1;
+		model->boot_count >>= 1;
+	}
+	model->boot_sum_lat += latency;
+	model->boot_sum_kib += lm_boot_kib(block_size);
+	model->boot_count++;
+
+	// Plan with twice the observed cost until the model has learned
+	WRITE_ONCE(model->boot_lat_per_kib,
+		div64_u64(model->boot_sum_lat * 2, model->boot_sum_kib));
+}
+
+// Seed the bootstrap estimate from the current model before it is reset
+static void lm_bootstrap_seed(struct latency_model *model) {
+	guard(spinlock_irqsave)(&model->buckets_lock);
+
+	model->boot_sum_lat = 0;
+	model->boot_sum_kib = 0;
+	model->boot_count = 0;
+	if (model->base)
+		WRITE_ONCE(model->boot_lat_per_kib,
+			max(div_u64(model->base * 2, LM_BOOT_MIN_KIB), model->slope * 2));
+}
+
+// Whether batches may grow past a request of this model's optype
+static bool lm_ready(struct latency_model *model) {
+	return READ_ONCE(model->base) || (READ_ONCE(model->bootstrap) &&
+		READ_ONCE(model->boot_lat_per_kib));
+}
+
 // Input latency data into the latency model
 static void latency_model_input(struct latency_model *model,
 		u32 block_size, u64 latency, u64 pred_lat) {
@@ -390,6 +669,9 @@ static void latency_model_input(struct latency_model *model,
 
 	spin_lock_irqsave(&model->buckets_lock, flags);
 
+	if (unlikely(!model->base))
+		lm_input_bootstrap(model, block_size, latency);
+
 	if (block_size <= LM_BLOCK_SIZE_THRESHOLD) {
 		// Handle small requests
 
@@ -402,6 +684,9 @@ static void latency_model_input(struct latency_model *model,
 		model->small_bucket[bucket_index].count++;
 		model->small_bucket[bucket_index].sum_latency += latency;
 
+		if (likely(model->base))
+			lm_input_variance(model, latency, model->base);
+
 		if (unlikely(!model->base)) {
 			spin_unlock_irqrestore(&model->buckets_lock, flags);
 			latency_model_update(model);
@@ -423,6 +708,8 @@ static void latency_model_input(struct latency_model *model,
 		model->large_bucket[bucket_index].count++;
 		model->large_bucket[bucket_index].sum_latency += latency;
 		model->large_bucket[bucket_index].sum_block_size += block_size;
+
+		lm_input_variance(model, latency, pred_lat);
 	}
 
 	spin_unlock_irqrestore(&model->buckets_lock, flags);
@@ -433,6 +720,11 @@ static u64 latency_model_predict(struct latency_model *model, u32 block_size) {
 	u64 result;
 
 	guard(spinlock_irqsave)(&model->lock);
+
+	// Fall back to the provisional estimate until a base is learned
+	if (unlikely(!model->base) && model->bootstrap)
+		return READ_ONCE(model->boot_lat_per_kib) * lm_boot_kib(block_size);
+
 	// Predict latency based on the model
 	result = model->base;
 	if (block_size > LM_BLOCK_SIZE_THRESHOLD)
@@ -442,9 +734,55 @@ static u64 latency_model_predict(struct latency_model *model, u32 block_size) {
 	return result;
 }
 
-// Determine the type of operation based on request flags
-static u8 adios_optype(struct request *rq) {
-	blk_opf_t opf = rq->cmd_flags;
+// Add the configured k·σ safety margin to a mean latency prediction
+static u64 latency_model_plan(
+		struct adios_data *ad, u8 optype, u64 pred_lat) {
+	u64 stddev;
+
+	if (!ad->lat_sigma_k)
+		return pred_lat;
+
+	stddev = READ_ONCE(ad->latency_model[optype].stddev);
+	return pred_lat + div_u64(stddev * ad->lat_sigma_k, 100);
+}
+
+// Scale a write prediction by the learned relative cost of its lifetime hint
+static u64 write_hint_adjust(
+		struct adios_data *ad, struct request *rq, u64 pred_lat) {
+	u32 cost;
+
+	if (!ad->write_hint_learn || req_op(rq) != REQ_OP_WRITE ||
+			rq->write_hint >= ADIOS_WRITE_HINTS)
+		return pred_lat;
+
+	cost = READ_ONCE(ad->write_hint_cost[rq->write_hint]);
+	return (pred_lat * cost) >> 10;
+}
+
+// Learn the measured-to-predicted latency ratio of a write lifetime hint
+static void write_hint_input(
+		struct adios_data *ad, struct request *rq, u64 latency, u64 pred_lat) {
+	u32 cost, ratio;
+
+	if (!pred_lat || rq->write_hint >= ADIOS_WRITE_HINTS)
+		return;
+
+	ratio = min_t(u64, div64_u64(latency * WH_COST_ONE, pred_lat), WH_COST_MAX);
+	cost = READ_ONCE(ad->write_hint_cost[rq->write_hint]);
+	cost = cost - (cost >> WH_COST_EWMA_SHIFT) + (ratio >> WH_COST_EWMA_SHIFT);
+	WRITE_ONCE(ad->write_hint_cost[rq->write_hint], cost);
+}
+
+// Convert summed predicted latency into the latency it takes on the device
+static u64 adios_window_lat(struct adios_data *ad, u64 lat) {
+	if (!ad->parallelism_scaling)
+		return lat;
+
+	return div_u64(lat * PAR_ONE, READ_ONCE(ad->parallelism));
+}
+
+// Determine the type of operation based on operation flags
+static u8 adios_opf_optype(blk_opf_t opf) {
 	switch (opf & REQ_OP_MASK) {
 	case REQ_OP_READ:
 		return ADIOS_READ;
@@ -457,6 +795,11 @@ static u8 adios_optype(struct request *rq) {
 	}
 }
 
+// Determine the type of operation based on request flags
+static inline u8 adios_optype(struct request *rq) {
+	return adios_opf_optype(rq->cmd_flags);
+}
+
 static inline u8 adios_optype_not_read(struct request *rq) {
 	return (rq->cmd_flags & REQ_OP_MASK) != REQ_OP_READ;
 }
@@ -466,21 +809,120 @@ static inline struct adios_rq_data *get_rq_data(struct request *rq) {
 	return (struct adios_rq_data *)rq->elv.priv[0];
 }
 
-// Add a request to the deadline-sorted red-black tree
-static void add_to_dl_tree(
-		struct adios_data *ad, bool dl_idx, struct request *rq) {
+// Get the per-partition slot of a request, if it has one
+static struct adios_part *adios_rq_part(struct adios_data *ad, struct request *rq) {
+	u8 partno;
+
+	if (!rq->part)
+		return NULL;
+	partno = bdev_partno(rq->part);
+	return partno < ADIOS_PARTS ? &ad->part[partno] : NULL;
+}
+
+// Whether a request reads swapped-out pages back in. Swap-out writes come
+// from reclaim writeback and keep the ordinary write target.
+static inline bool adios_rq_swapin(struct request *rq) {
+	return (rq->cmd_flags & REQ_SWAP) && req_op(rq) == REQ_OP_READ;
+}
+
+// Get the latency target of a request, tightened by its class
+static u64 adios_rq_target(
+		struct adios_data *ad, struct request *rq, u8 optype, bool *urgent) {
+	u64 target = ad->latency_target[optype];
+	u16 hint = IOPRIO_PRIO_HINT(req_get_ioprio(rq));
+	struct adios_part *part = adios_rq_part(ad, rq);
+	u64 class_target;
+
+	*urgent = false;
+
+	// A partition's own target replaces the queue-wide one
+	if (part) {
+		class_target = READ_ONCE(part->latency_target[optype]);
+		if (class_target) {
+			*urgent = class_target < target;
+			target = class_target;
+		}
+	}
+
+	// Swap-in reads stall page faults
+	if (adios_rq_swapin(rq)) {
+		class_target = READ_ONCE(ad->swap_target);
+		if (class_target && class_target < target) {
+			target = class_target;
+			*urgent = true;
+		}
+	}
+
+	if (hint >= IOPRIO_HINT_DEV_DURATION_LIMIT_1 &&
+			hint <= IOPRIO_HINT_DEV_DURATION_LIMIT_7) {
+		class_target = READ_ONCE(ad->cdl_target[hint]);
+		if (class_target && class_target < target) {
+			target = class_target;
+			*urgent = true;
+		}
+	}
+
+	return target;
+}
+
+// Scale a deadline offset by the request's partition priority, so that a
+// favoured partition sorts ahead of others with the same target
+static s64 adios_part_scale(
+		struct adios_data *ad, struct request *rq, s64 offset) {
+	struct adios_part *part = adios_rq_part(ad, rq);
+	s64 weight;
+
+	if (!part || !part->prio_set)
+		return offset;
+
+	weight = adios_prio_to_weight[part->prio + 20];
+	// An overdue request moves further into the past when favoured
+	if (offset < 0)
+		return div_s64(offset * weight, 1024);
+	return div_s64(offset * 1024, weight);
+}
+
+// Predict the latency of a request with the current model generation
+static void dl_predict(struct adios_data *ad, struct request *rq, u8 optype) {
+	struct adios_rq_data *rd = get_rq_data(rq);
+
+	rd->block_size = blk_rq_bytes(rq);
+	rd->model_gen = READ_ONCE(ad->latency_model[optype].gen);
+	rd->pred_lat =
+		latency_model_predict(&ad->latency_model[optype], rd->block_size);
+	rd->plan_lat = latency_model_plan(ad, optype,
+		write_hint_adjust(ad, rq, rd->pred_lat));
+}
+
+// Re-predict a queued request in place, keeping its deadline
+static void dl_refresh_pred(struct adios_data *ad, struct request *rq) {
+	struct adios_rq_data *rd = get_rq_data(rq);
+	u8 optype = adios_optype(rq);
+
+	ad->queued_pred_lat[optype] -= rd->plan_lat;
+	dl_predict(ad, rq, optype);
+	ad->queued_pred_lat[optype] += rd->plan_lat;
+}
+
+// Add a request to the deadline-sorted red-black tree, preferring a spare group
+static bool dl_tree_insert(struct adios_data *ad, bool dl_idx,
+		struct request *rq, struct dl_group **spare) {
 	struct rb_root_cached *root = &ad->dl_tree[dl_idx];
 	struct rb_node **link = &(root->rb_root.rb_node), *parent = NULL;
 	bool leftmost = true;
 	struct adios_rq_data *rd = get_rq_data(rq);
 	struct dl_group *dlg;
 
-	rd->block_size = blk_rq_bytes(rq);
 	u8 optype = adios_optype(rq);
-	rd->pred_lat =
-		latency_model_predict(&ad->latency_model[optype], rd->block_size);
-	rd->deadline =
-		rq->start_time_ns + ad->latency_target[optype] + rd->pred_lat;
+	dl_predict(ad, rq, optype);
+	u64 target = adios_rq_target(ad, rq, optype, &rd->urgent);
+	s64 offset;
+	// Least-laxity mode orders by the latest start that still meets the target
+	if (ad->least_laxity)
+		offset = (s64)target - (s64)rd->plan_lat;
+	else
+		offset = target + rd->plan_lat;
+	rd->deadline = rq->start_time_ns + adios_part_scale(ad, rq, offset);
 
 	while (*link) {
 		dlg = rb_entry(*link, struct dl_group, node);
@@ -499,9 +941,14 @@ static void add_to_dl_tree(
 
 	dlg = rb_entry_safe(parent, struct dl_group, node);
 	if (!dlg || dlg->deadline != rd->deadline) {
-		dlg = kmem_cache_zalloc(ad->dl_group_pool, GFP_ATOMIC);
+		if (spare && *spare) {
+			dlg = *spare;
+			*spare = NULL;
+		} else {
+			dlg = kmem_cache_zalloc(ad->dl_group_pool, GFP_ATOMIC);
+		}
 		if (!dlg)
-			return;
+			return false;
 		dlg->deadline = rd->deadline;
 		INIT_LIST_HEAD(&dlg->rqs);
 		rb_link_node(&dlg->node, parent, link);
@@ -511,6 +958,14 @@ found:
 	list_add_tail(&rd->dl_node, &dlg->rqs);
 	rd->dl_group = &dlg->rqs;
 	ad->dl_queued |= 1 << dl_idx;
+	ad->queued_pred_lat[optype] += rd->plan_lat;
+	return true;
+}
+
+// Add a request to the deadline-sorted red-black tree
+static void add_to_dl_tree(
+		struct adios_data *ad, bool dl_idx, struct request *rq) {
+	dl_tree_insert(ad, dl_idx, rq, NULL);
 }
 
 // Remove a request from the deadline-sorted red-black tree
@@ -526,11 +981,162 @@ static void del_from_dl_tree(
 		kmem_cache_free(ad->dl_group_pool, dlg);
 	}
 	rd->dl_group = NULL;
+	ad->queued_pred_lat[adios_optype(rq)] -= rd->plan_lat;
 
 	if (RB_EMPTY_ROOT(&ad->dl_tree[dl_idx].rb_root))
 		ad->dl_queued &= ~(1 << dl_idx);
 }
 
+// Arm the dispatch timer to re-run the hardware queues at a given time
+static void adios_kick_at(struct adios_data *ad, u64 when_ns) {
+	// Keep an earlier pending kick; that run re-arms for the later one
+	if (hrtimer_is_queued(&ad->dispatch_timer) &&
+			ktime_to_ns(hrtimer_get_expires(&ad->dispatch_timer)) <= when_ns)
+		return;
+	hrtimer_start(&ad->dispatch_timer, ns_to_ktime(when_ns), HRTIMER_MODE_ABS);
+}
+
+// Get the optimal write unit of the device in bytes (0: none reported)
+static u32 write_align_unit(struct request_queue *q) {
+	u32 unit = queue_io_opt(q);
+
+	if (!unit && queue_io_min(q) > queue_logical_block_size(q))
+		unit = queue_io_min(q);
+	return unit;
+}
+
+// Get the time until which an async write is held back from batching (0: none)
+static u64 write_hold_until(struct adios_data *ad, struct request *rq, u64 now) {
+	struct adios_rq_data *rd = get_rq_data(rq);
+	u64 merge_delay = READ_ONCE(ad->write_merge_delay);
+	u64 align_hold = READ_ONCE(ad->write_align_hold);
+	u64 until = 0;
+
+	if (adios_optype(rq) != ADIOS_WRITE || op_is_sync(rq->cmd_flags))
+		return 0;
+
+	// Give young writes time to collect merges
+	if (merge_delay)
+		until = rq->start_time_ns + merge_delay;
+
+	// Hold writes ending inside a unit until merges complete it
+	if (align_hold) {
+		u32 unit = write_align_unit(ad->queue);
+		u64 end = (blk_rq_pos(rq) + blk_rq_sectors(rq)) << SECTOR_SHIFT;
+
+		if (unit && do_div(end, unit)) {
+			// Never hold past the latest start that still meets the target
+			bool urgent;
+			u64 due = rq->start_time_ns +
+				adios_rq_target(ad, rq, ADIOS_WRITE, &urgent);
+			u64 latest = due > rd->plan_lat ? due - rd->plan_lat : 0;
+
+			until = max(until,
+				min(rq->start_time_ns + align_hold, latest));
+		}
+	}
+
+	return until > now ? until : 0;
+}
+
+// Park a held write outside the tree, sorted by the time its hold expires
+static void dl_park_insert(
+		struct adios_data *ad, struct adios_rq_data *rd, u64 until) {
+	struct adios_rq_data *pos;
+
+	rd->hold_until = until;
+	list_for_each_entry_reverse(pos, &ad->held_rqs, dl_node)
+		if (pos->hold_until <= until)
+			break;
+	list_add(&rd->dl_node, &pos->dl_node);
+}
+
+// Move a held write from the write tree to the held list
+static void dl_park(struct adios_data *ad, struct request *rq, u64 until) {
+	struct adios_rq_data *rd = get_rq_data(rq);
+
+	del_from_dl_tree(ad, 1, rq);
+	// A parked write is still queued
+	ad->queued_pred_lat[ADIOS_WRITE] += rd->plan_lat;
+	dl_park_insert(ad, rd, until);
+}
+
+// Take a parked write off the held list
+static void dl_unpark(struct adios_data *ad, struct request *rq) {
+	struct adios_rq_data *rd = get_rq_data(rq);
+
+	list_del_init(&rd->dl_node);
+	rd->hold_until = 0;
+	ad->queued_pred_lat[ADIOS_WRITE] -= rd->plan_lat;
+}
+
+// Move a parked write back into the write tree; false if out of memory
+static bool dl_release(struct adios_data *ad, struct request *rq) {
+	// Allocate first so that the request cannot drop out of the scheduler
+	struct dl_group *spare = kmem_cache_zalloc(ad->dl_group_pool, GFP_ATOMIC);
+
+	if (!spare)
+		return false;
+
+	dl_unpark(ad, rq);
+	dl_tree_insert(ad, 1, rq, &spare);
+	if (spare)
+		kmem_cache_free(ad->dl_group_pool, spare);
+	return true;
+}
+
+// Release the parked writes whose hold has expired; returns the next expiry
+static u64 dl_release_expired(struct adios_data *ad, u64 now) {
+	struct adios_rq_data *rd;
+
+	lockdep_assert_held(&ad->lock);
+
+	while ((rd = list_first_entry_or_null(
+			&ad->held_rqs, struct adios_rq_data, dl_node))) {
+		if (rd->hold_until > now)
+			return rd->hold_until;
+		// Retry shortly when no group can be allocated
+		if (!dl_release(ad, rd->rq))
+			return now + NSEC_PER_MSEC;
+	}
+	return 0;
+}
+
+// Re-evaluate the hold of a parked write that grew by merging
+static void dl_rehold(struct adios_data *ad, struct request *rq) {
+	struct adios_rq_data *rd = get_rq_data(rq);
+	u64 until = write_hold_until(ad, rq, ktime_get_ns());
+
+	// Release it once complete. Without memory for a group it stays
+	// parked until its old hold expires.
+	if (!until) {
+		dl_release(ad, rq);
+		return;
+	}
+
+	list_del(&rd->dl_node);
+	dl_park_insert(ad, rd, until);
+	adios_kick_at(ad, until);
+}
+
+// Release due held writes and re-run the hardware queues
+static enum hrtimer_restart adios_dispatch_timer_fn(struct hrtimer *t) {
+	struct adios_data *ad = container_of(t, struct adios_data, dispatch_timer);
+	u64 next = 0;
+
+	// Parked writes are invisible to has_work until released here
+	scoped_guard(spinlock_irqsave, &ad->lock)
+		next = dl_release_expired(ad, ktime_get_ns());
+
+	// Held requests become dispatchable; let has_work see them again
+	WRITE_ONCE(ad->throttled, false);
+	blk_mq_run_hw_queues(ad->queue, true);
+
+	if (next)
+		adios_kick_at(ad, next);
+	return HRTIMER_NORESTART;
+}
+
 // Remove a request from the scheduler
 static void remove_request(struct adios_data *ad, struct request *rq) {
 	bool dl_idx = adios_optype_not_read(rq);
@@ -538,9 +1144,12 @@ static void remove_request(struct adios_data *ad, struct request *rq) {
 	struct adios_rq_data *rd = get_rq_data(rq);
 
 	list_del_init(&rq->queuelist);
+	list_del_init(&rd->group_node);
 
 	// We might not be on the rbtree, if we are doing an insert merge
-	if (rd->dl_group)
+	if (rd->hold_until)
+		dl_unpark(ad, rq);
+	else if (rd->dl_group)
 		del_from_dl_tree(ad, dl_idx, rq);
 
 	elv_rqhash_del(q, rq);
@@ -556,9 +1165,73 @@ static int to_word_depth(struct blk_mq_hw_ctx *hctx, unsigned int qdepth) {
 	return ((qdepth << bt->sb.shift) + nrr - 1) / nrr;
 }
 
+// Predicted backlog of an optype, queued in the scheduler and in flight
+static u64 adios_backlog(struct adios_data *ad, u8 optype) {
+	return READ_ONCE(ad->queued_pred_lat[optype]) +
+		atomic64_read(&ad->optype_pred_lat[optype]);
+}
+
+// Publish the latency models and backlog to the predictor page
+static void adios_info_publish(struct adios_data *ad) {
+	struct adios_info_page *info = ad->info;
+	unsigned long flags;
+
+	// Nobody looks; opening the file publishes a fresh snapshot
+	if (!atomic_read(&ad->info_users))
+		return;
+
+	spin_lock_irqsave(&ad->info_lock, flags);
+	WRITE_ONCE(info->seq, info->seq + 1);
+	smp_wmb();
+
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
+		struct latency_model *model = &ad->latency_model[i];
+
+		WRITE_ONCE(info->optype[i].base, READ_ONCE(model->base));
+		WRITE_ONCE(info->optype[i].slope, READ_ONCE(model->slope));
+		WRITE_ONCE(info->optype[i].stddev, READ_ONCE(model->stddev));
+		WRITE_ONCE(info->optype[i].backlog, adios_backlog(ad, i));
+	}
+	WRITE_ONCE(info->total_backlog, atomic64_read(&ad->total_pred_lat));
+	WRITE_ONCE(info->parallelism, READ_ONCE(ad->parallelism));
+
+	smp_wmb();
+	WRITE_ONCE(info->seq, info->seq + 1);
+	spin_unlock_irqrestore(&ad->info_lock, flags);
+}
+
+// Publish only the backlog to the predictor page while it is open
+static void adios_info_publish_backlog(struct adios_data *ad) {
+	struct adios_info_page *info = ad->info;
+	unsigned long flags;
+
+	if (!atomic_read(&ad->info_users))
+		return;
+
+	spin_lock_irqsave(&ad->info_lock, flags);
+	WRITE_ONCE(info->seq, info->seq + 1);
+	smp_wmb();
+
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++)
+		WRITE_ONCE(info->optype[i].backlog, adios_backlog(ad, i));
+	WRITE_ONCE(info->total_backlog, atomic64_read(&ad->total_pred_lat));
+
+	smp_wmb();
+	WRITE_ONCE(info->seq, info->seq + 1);
+	spin_unlock_irqrestore(&ad->info_lock, flags);
+}
+
 // Limit the depth of request allocation for asynchronous and write requests
 static void adios_limit_depth(blk_opf_t opf, struct blk_mq_alloc_data *data) {
 	struct adios_data *ad = data->q->elevator->elevator_data;
+	u8 optype = adios_opf_optype(opf);
+
+	// Throttle submitters before allocation while their backlog is too large
+	if (ad->throttle_backlog[optype] &&
+			adios_backlog(ad, optype) > ad->throttle_backlog[optype]) {
+		data->shallow_depth = to_word_depth(data->hctx, 1);
+		return;
+	}
 
 	// Do not throttle synchronous reads
 	if (op_is_sync(opf) && !op_is_write(opf))
@@ -584,6 +1257,12 @@ static void adios_request_merged(struct request_queue *q, struct request *req,
 	bool dl_idx = adios_optype_not_read(req);
 	struct adios_data *ad = q->elevator->elevator_data;
 
+	// A parked write may have been completed by the merge
+	if (get_rq_data(req)->hold_until) {
+		dl_rehold(ad, req);
+		return;
+	}
+
 	// if the merge was a front merge, we need to reposition request
 	if (type == ELEVATOR_FRONT_MERGE) {
 		del_from_dl_tree(ad, dl_idx, req);
@@ -600,6 +1279,9 @@ static void adios_merged_requests(struct request_queue *q, struct request *req,
 
 	// kill knowledge of next, this one is a goner
 	remove_request(ad, next);
+
+	if (get_rq_data(req)->hold_until)
+		dl_rehold(ad, req);
 }
 
 // Try to merge a bio into an existing rq before associating it with an rq
@@ -620,9 +1302,20 @@ static bool adios_bio_merge(struct request_queue *q, struct bio *bio,
 	return ret;
 }
 
+// Whether the predicted backlog of an optype rules out REQ_NOWAIT requests
+static bool nowait_backlog_exceeded(struct adios_data *ad, struct request *rq) {
+	u8 optype = adios_optype(rq);
+
+	if (!(rq->cmd_flags & REQ_NOWAIT) || !ad->nowait_backlog[optype])
+		return false;
+
+	return adios_backlog(ad, optype) > ad->nowait_backlog[optype];
+}
+
 // Insert a request into the scheduler
 static void insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
-				  blk_insert_t insert_flags, struct list_head *free) {
+				  blk_insert_t insert_flags, struct list_head *free,
+				  struct list_head *rejected) {
 	unsigned long flags;
 	bool dl_idx = adios_optype_not_read(rq);
 	struct request_queue *q = hctx->queue;
@@ -637,6 +1330,12 @@ static void insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 		return;
 	}
 
+	// Fail fast instead of queueing when the device is overloaded
+	if (nowait_backlog_exceeded(ad, rq)) {
+		list_add_tail(&rq->queuelist, rejected);
+		return;
+	}
+
 	if (blk_mq_sched_try_insert_merge(q, rq, free))
 		return;
 
@@ -649,6 +1348,39 @@ static void insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 	}
 }
 
+// Send a request straight to dispatch while the scheduler is nearly idle
+static bool try_fast_path(struct adios_data *ad, struct request *rq) {
+	struct adios_rq_data *rd = get_rq_data(rq);
+	u8 optype = adios_optype(rq);
+	u8 page = READ_ONCE(ad->bq_page);
+	u64 tpl;
+
+	// Only when nothing is waiting in the deadline trees or batch queues
+	if (READ_ONCE(ad->dl_queued) || READ_ONCE(ad->more_bq_ready) ||
+			!list_empty_careful(&ad->held_rqs))
+		return false;
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++)
+		if (!list_empty(&ad->batch_queue[page][i]))
+			return false;
+
+	rd->block_size = blk_rq_bytes(rq);
+	rd->pred_lat =
+		latency_model_predict(&ad->latency_model[optype], rd->block_size);
+	rd->plan_lat = latency_model_plan(ad, optype, rd->pred_lat);
+
+	tpl = atomic64_read(&ad->total_pred_lat);
+	if (adios_window_lat(ad, tpl + rd->plan_lat) * 100 >
+			ad->global_latency_window * ad->fast_path_ratio)
+		return false;
+
+	atomic64_add(rd->plan_lat, &ad->total_pred_lat);
+	atomic64_add(rd->plan_lat, &ad->optype_pred_lat[optype]);
+
+	scoped_guard(spinlock_irqsave, &ad->pq_lock)
+		list_move_tail(&rq->queuelist, &ad->prio_queue);
+	return true;
+}
+
 // Insert multiple requests into the scheduler
 static void adios_insert_requests(struct blk_mq_hw_ctx *hctx,
 				   struct list_head *list,
@@ -656,19 +1388,50 @@ static void adios_insert_requests(struct blk_mq_hw_ctx *hctx,
 	unsigned long flags;
 	struct request_queue *q = hctx->queue;
 	struct adios_data *ad = q->elevator->elevator_data;
+	struct adios_rq_data *group = NULL;
+	bool grouped = !list_is_singular(list);
 	LIST_HEAD(free);
+	LIST_HEAD(rejected);
+
+	// New requests may be dispatchable even while the batch is throttled
+	WRITE_ONCE(ad->throttled, false);
+
+	if (ad->fast_path_ratio && !grouped &&
+			!(insert_flags & BLK_MQ_INSERT_AT_HEAD) &&
+			try_fast_path(ad, list_first_entry(list, struct request, queuelist)))
+		return;
 
 	spin_lock_irqsave(&ad->lock, flags);
 	while (!list_empty(list)) {
 		struct request *rq;
+		struct adios_rq_data *rd;
 
 		rq = list_first_entry(list, struct request, queuelist);
 		list_del_init(&rq->queuelist);
-		insert_request(hctx, rq, insert_flags, &free);
+		insert_request(hctx, rq, insert_flags, &free, &rejected);
+
+		// Tag requests of the same plug flush that made it into the tree
+		rd = get_rq_data(rq);
+		if (!grouped || !rd->dl_group)
+			continue;
+		if (group)
+			list_add_tail(&rd->group_node, &group->group_node);
+		else
+			group = rd;
 	}
 	spin_unlock_irqrestore(&ad->lock, flags);
 
+	adios_info_publish_backlog(ad);
 	blk_mq_free_requests(&free);
+
+	// Complete rejected REQ_NOWAIT requests with -EAGAIN
+	while (!list_empty(&rejected)) {
+		struct request *rq;
+
+		rq = list_first_entry(&rejected, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		blk_mq_end_request(rq, BLK_STS_AGAIN);
+	}
 }
 
 // Prepare a request before it is inserted into the scheduler
@@ -685,51 +1448,93 @@ static void adios_prepare_request(struct request *rq) {
 		return;
 
 	rd->rq = rq;
+	INIT_LIST_HEAD(&rd->group_node);
 	rq->elv.priv[0] = rd;
 }
 
-static struct adios_rq_data *get_dl_first_rd(struct adios_data *ad, bool idx) {
-	struct rb_root_cached *root = &ad->dl_tree[idx];
-	struct rb_node *first = rb_first_cached(root);
-	struct dl_group *dl_group = rb_entry(first, struct dl_group, node);
-	struct adios_rq_data *rd =
-		list_first_entry(&dl_group->rqs, struct adios_rq_data, dl_node);
+// Get the earliest request of a tree whose optype is not masked out
+static struct adios_rq_data *get_dl_first_rd(
+		struct adios_data *ad, bool idx, u8 optype_mask) {
+	struct rb_node *node = rb_first_cached(&ad->dl_tree[idx]);
+	struct adios_rq_data *rd;
+	u8 scanned = 0;
+
+	for (; node; node = rb_next(node)) {
+		struct dl_group *dl_group = rb_entry(node, struct dl_group, node);
+
+		list_for_each_entry(rd, &dl_group->rqs, dl_node) {
+			if (!(optype_mask & (1 << adios_optype(rd->rq))))
+				return rd;
+			// Give up on the tree behind a long run of masked requests
+			if (++scanned >= ADIOS_MASKED_SCAN)
+				return NULL;
+		}
+	}
+
+	return NULL;
+}
+
+// Get the priority a request is charged at in read/write arbitration. A
+// partition priority also scales the deadline, see adios_part_scale().
+static s32 adios_rq_prio(
+		struct adios_data *ad, struct adios_rq_data *rd, bool dl_idx) {
+	struct adios_part *part;
+
+	if (rd->urgent && adios_rq_swapin(rd->rq))
+		return ad->swap_prio;
+
+	part = adios_rq_part(ad, rd->rq);
+	if (part && part->prio_set)
+		return part->prio;
 
-	return rd;
+	return ad->dl_prio[dl_idx];
 }
 
 // Select the next request to dispatch from the deadline-sorted red-black tree
-static struct request *next_request(struct adios_data *ad) {
+static struct request *next_request(struct adios_data *ad, u8 optype_mask) {
+	struct adios_rq_data *trd[2] = { NULL, NULL };
 	struct adios_rq_data *rd;
 	bool dl_idx, bias_idx, reduce_bias;
+	u8 dl_queued = 0;
 
-	if (!ad->dl_queued)
+	for (u8 i = 0; i < 2; i++) {
+		if (ad->dl_queued & (1 << i))
+			trd[i] = get_dl_first_rd(ad, i, optype_mask);
+		if (trd[i])
+			dl_queued |= 1 << i;
+	}
+
+	if (!dl_queued)
 		return NULL;
 
-	dl_idx = ad->dl_queued >> 1;
-	rd = get_dl_first_rd(ad, dl_idx);
+	dl_idx = dl_queued >> 1;
+	rd = trd[dl_idx];
 
 	bias_idx = ad->dl_bias < 0;
 	reduce_bias = (bias_idx == dl_idx);
 
-	if (ad->dl_queued == 0x3) {
-		struct adios_rq_data *trd[2];
-		trd[0] = get_dl_first_rd(ad, 0);
-		trd[1] = rd;
-
+	if (dl_queued == 0x3) {
 		rd = trd[bias_idx];
 
 		reduce_bias =
 			(trd[bias_idx]->deadline > trd[((u8)bias_idx + 1) % 2]->deadline);
-	}
+
+		// A duration-limited head due first is not held back by the bias
+		struct adios_rq_data *other = trd[((u8)bias_idx + 1) % 2];
+		if (other->urgent && !rd->urgent && other->deadline <= rd->deadline) {
+			rd = other;
+			reduce_bias = false;
+		}
+	}
 
 	if (reduce_bias) {
 		s64 sign = ((int)bias_idx << 1) - 1;
+		s32 prio = adios_rq_prio(ad, rd, bias_idx);
 		if (unlikely(!rd->pred_lat))
 			ad->dl_bias = sign;
 		else {
 			ad->dl_bias += sign * (s64)((rd->pred_lat *
-				adios_prio_to_weight[ad->dl_prio[bias_idx] + 20]) >> 10);
+				adios_prio_to_weight[prio + 20]) >> 10);
 		}
 	}
 
@@ -751,6 +1556,66 @@ static void init_batch_queues(struct adios_data *ad) {
 	}
 }
 
+// Whether an optype's own in-flight window has no room for a request
+static bool optype_window_full(struct adios_data *ad, u8 optype, u64 plan_lat) {
+	u64 optype_lat;
+
+	if (!ad->latency_window[optype])
+		return false;
+
+	optype_lat = atomic64_read(&ad->optype_pred_lat[optype]);
+	return optype_lat && adios_window_lat(ad, optype_lat + plan_lat) >
+		ad->latency_window[optype];
+}
+
+// Queue a write behind the last batched write with the same lifetime hint
+static void bq_add_write(struct list_head *head, struct request *rq) {
+	struct request *pos;
+
+	list_for_each_entry_reverse(pos, head, queuelist) {
+		if (pos->write_hint == rq->write_hint) {
+			list_add(&rq->queuelist, &pos->queuelist);
+			return;
+		}
+	}
+	list_add_tail(&rq->queuelist, head);
+}
+
+// Move a request from the deadline-sorted tree to a batch queue page
+static void add_to_batch(
+		struct adios_data *ad, struct request *rq, u8 page, u8 optype) {
+	struct adios_rq_data *rd = get_rq_data(rq);
+	struct adios_batch_stat *stat;
+
+	remove_request(ad, rq);
+
+	rd->batch_seq = ad->batch_seq;
+	stat = &ad->batch_stat[ad->batch_seq % ADIOS_BATCH_TRACK];
+	stat->sum_lat += rd->pred_lat;
+	atomic64_inc(&stat->state);
+
+	if (optype == ADIOS_WRITE && ad->write_hint_group)
+		bq_add_write(&ad->batch_queue[page][optype], rq);
+	else
+		list_add_tail(&rq->queuelist, &ad->batch_queue[page][optype]);
+	ad->batch_count[page][optype]++;
+	atomic64_add(rd->plan_lat, &ad->total_pred_lat);
+	atomic64_add(rd->plan_lat, &ad->optype_pred_lat[optype]);
+}
+
+// Claim a sequence and a tracking slot for a batch getting its first request
+static void batch_stat_begin(struct adios_data *ad) {
+	struct adios_batch_stat *stat;
+
+	if (!++ad->batch_seq)
+		ad->batch_seq++;
+	stat = &ad->batch_stat[ad->batch_seq % ADIOS_BATCH_TRACK];
+	stat->start_ns = 0;
+	stat->sum_lat = 0;
+	// Publish the new sequence only after the slot is cleared
+	atomic64_set_release(&stat->state, (s64)((u64)ad->batch_seq << 32));
+}
+
 // Fill the batch queues with requests from the deadline-sorted red-black tree
 static bool fill_batch_queues(struct adios_data *ad, u64 current_lat) {
 	unsigned long flags;
@@ -758,37 +1623,120 @@ static bool fill_batch_queues(struct adios_data *ad, u64 current_lat) {
 	u32 optype_count[ADIOS_OPTYPES];
 	memset(optype_count, 0, sizeof(optype_count));
 	u8 page = (ad->bq_page + 1) % ADIOS_BQ_PAGES;
+	u8 optype_mask = 0;
+	LIST_HEAD(group);
+	u64 now = 0;
+	u64 hold_until = 0;
 
 	reset_batch_counts(ad, page);
 
 	spin_lock_irqsave(&ad->lock, flags);
+	if (READ_ONCE(ad->write_merge_delay) || READ_ONCE(ad->write_align_hold) ||
+			!list_empty(&ad->held_rqs))
+		now = ktime_get_ns();
+	// Parked writes whose hold expired compete for this batch again
+	if (!list_empty(&ad->held_rqs))
+		dl_release_expired(ad, now);
 	while (true) {
-		struct request *rq = next_request(ad);
+		struct request *rq = next_request(ad, optype_mask);
 		if (!rq)
 			break;
 
 		struct adios_rq_data *rd = get_rq_data(rq);
 		u8 optype = adios_optype(rq);
-		current_lat += rd->pred_lat;
+
+		// Re-deadline requests predicted by an outdated model generation
+		if (unlikely(rd->model_gen !=
+				READ_ONCE(ad->latency_model[optype].gen))) {
+			bool dl_idx = adios_optype_not_read(rq);
+			// Allocate first so that the request cannot drop out of the tree
+			struct dl_group *spare =
+				kmem_cache_zalloc(ad->dl_group_pool, GFP_ATOMIC);
+
+			if (likely(spare)) {
+				del_from_dl_tree(ad, dl_idx, rq);
+				dl_tree_insert(ad, dl_idx, rq, &spare);
+				if (spare)
+					kmem_cache_free(ad->dl_group_pool, spare);
+				continue;
+			}
+
+			// Without memory to re-sort it, batch it by its old deadline
+			dl_refresh_pred(ad, rq);
+		}
+
+		// Hold async writes that may still grow by merging
+		u64 until = now ? write_hold_until(ad, rq, now) : 0;
+		if (until) {
+			dl_park(ad, rq, until);
+			continue;
+		}
+
+		// Stop taking this optype once its own window is full
+		if (optype_window_full(ad, optype, rd->plan_lat)) {
+			optype_mask |= 1 << optype;
+			continue;
+		}
+
+		current_lat += rd->plan_lat;
 
 		// Check batch size and total predicted latency
-		if (count && (!ad->latency_model[optype].base || 
-			ad->batch_count[page][optype] >= ad->batch_limit[optype] ||
-			current_lat > ad->global_latency_window)) {
+		if (count && (!lm_ready(&ad->latency_model[optype]) ||
+			(!rd->urgent &&
+				ad->batch_count[page][optype] >= ad->batch_limit[optype]) ||
+			adios_window_lat(ad, current_lat) > ad->global_latency_window)) {
 			break;
 		}
 
-		remove_request(ad, rq);
+		// Detach the rest of the request's plug group before removing it
+		list_replace_init(&rd->group_node, &group);
+
+		// Start makespan accounting once the batch gets its first request
+		if (!count)
+			batch_stat_begin(ad);
 
 		// Add request to the corresponding batch queue
-		list_add_tail(&rq->queuelist, &ad->batch_queue[page][optype]);
-		ad->batch_count[page][optype]++;
-		atomic64_add(rd->pred_lat, &ad->total_pred_lat);
+		add_to_batch(ad, rq, page, optype);
 		optype_count[optype]++;
 		count++;
+
+		// Pull the rest of its plug group into the same page if it fits
+		struct adios_rq_data *grd, *tmp;
+		list_for_each_entry_safe(grd, tmp, &group, group_node) {
+			u8 gtype = adios_optype(grd->rq);
+
+			// Members follow the same hold and model generation rules
+			if (grd->hold_until ||
+					(now && write_hold_until(ad, grd->rq, now)))
+				continue;
+			if (unlikely(grd->model_gen !=
+					READ_ONCE(ad->latency_model[gtype].gen)))
+				dl_refresh_pred(ad, grd->rq);
+
+			if (!lm_ready(&ad->latency_model[gtype]) ||
+					ad->batch_count[page][gtype] >= ad->batch_limit[gtype] ||
+					adios_window_lat(ad, current_lat + grd->plan_lat) >
+						ad->global_latency_window ||
+					optype_window_full(ad, gtype, grd->plan_lat))
+				continue;
+
+			current_lat += grd->plan_lat;
+			add_to_batch(ad, grd->rq, page, gtype);
+			optype_count[gtype]++;
+			count++;
+		}
+		// Leave the members that did not fit linked to each other
+		list_del_init(&group);
 	}
+	// Parked writes are released by the dispatch timer
+	if (!list_empty(&ad->held_rqs))
+		hold_until = list_first_entry(&ad->held_rqs,
+			struct adios_rq_data, dl_node)->hold_until;
 	spin_unlock_irqrestore(&ad->lock, flags);
 
+	if (hold_until)
+		adios_kick_at(ad, hold_until);
+
 	if (count) {
 		ad->more_bq_ready = true;
 		for (u8 optype = 0; optype < ADIOS_OPTYPES; optype++) {
@@ -807,34 +1755,181 @@ static void flip_bq_page(struct adios_data *ad) {
 	ad->bq_page = (ad->bq_page + 1) % ADIOS_BQ_PAGES;
 }
 
+// Record the time the first request of a batch is dispatched
+static void batch_stat_start(struct adios_data *ad, struct adios_rq_data *rd) {
+	struct adios_batch_stat *stat =
+		&ad->batch_stat[rd->batch_seq % ADIOS_BATCH_TRACK];
+
+	if (BATCH_STAT_SEQ(atomic64_read(&stat->state)) == rd->batch_seq &&
+			!stat->start_ns)
+		stat->start_ns = ktime_get_ns();
+}
+
+// Learn the device parallelism once every request of a batch has completed
+static void batch_stat_complete(
+		struct adios_data *ad, struct adios_rq_data *rd, u64 now) {
+	struct adios_batch_stat *stat;
+	u64 makespan, sample;
+	s64 state;
+	u32 par;
+
+	if (!rd->batch_seq)
+		return;
+
+	// Decrement only while the slot still tracks this request's batch
+	stat = &ad->batch_stat[rd->batch_seq % ADIOS_BATCH_TRACK];
+	state = atomic64_read(&stat->state);
+	do {
+		if (BATCH_STAT_SEQ(state) != rd->batch_seq ||
+				!BATCH_STAT_PENDING(state))
+			return;
+	} while (!atomic64_try_cmpxchg(&stat->state, &state, state - 1));
+
+	if (BATCH_STAT_PENDING(state - 1))
+		return;
+
+	if (!stat->start_ns || now <= stat->start_ns || !stat->sum_lat)
+		return;
+
+	// Summed predicted latency over the measured makespan of the batch
+	makespan = now - stat->start_ns;
+	sample = clamp_t(u64, div64_u64(stat->sum_lat * PAR_ONE, makespan),
+		PAR_ONE, PAR_MAX);
+
+	par = READ_ONCE(ad->parallelism);
+	par = par - (par >> PAR_EWMA_SHIFT) + (sample >> PAR_EWMA_SHIFT);
+	WRITE_ONCE(ad->parallelism, par);
+}
+
+// Pick a batched request, preferring one submitted through the given hctx
+static struct request *bq_pick(struct adios_data *ad,
+		struct list_head *head, struct blk_mq_hw_ctx *hctx) {
+	struct request *rq;
+	u8 scanned = 0;
+
+	if (ad->dispatch_locality && hctx->queue->nr_hw_queues > 1) {
+		list_for_each_entry(rq, head, queuelist) {
+			if (rq->mq_hctx == hctx)
+				return rq;
+			if (++scanned >= ADIOS_LOCALITY_SCAN)
+				break;
+		}
+	}
+
+	return list_first_entry(head, struct request, queuelist);
+}
+
+// Take the first eligible request from a batch queue page
+static struct request *pop_from_bq_page(struct adios_data *ad,
+		struct blk_mq_hw_ctx *hctx, u8 page, u64 now, bool *paced) {
+	struct request *rq;
+
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
+		if (list_empty(&ad->batch_queue[page][i]))
+			continue;
+
+		// Hold writes back until the pacing interval has passed
+		if (i == ADIOS_WRITE && ad->write_pacing) {
+			if (now < ad->next_write_ns) {
+				*paced = true;
+				continue;
+			}
+		}
+
+		rq = bq_pick(ad, &ad->batch_queue[page][i], hctx);
+		list_del_init(&rq->queuelist);
+		batch_stat_start(ad, get_rq_data(rq));
+
+		if (i == ADIOS_WRITE && ad->write_pacing)
+			ad->next_write_ns = now + div_u64(
+				get_rq_data(rq)->pred_lat * ad->write_pacing, 100);
+		return rq;
+	}
+
+	return NULL;
+}
+
+// Whether the in-flight latency is low enough to refill the batch queues
+static bool bq_refill_allowed(struct adios_data *ad, u64 tpl) {
+	return !tpl || adios_window_lat(ad, tpl) <
+		ad->global_latency_window * ad->bq_refill_below_ratio / 100;
+}
+
+// Carry paced writes over to the next page so that their page can be refilled
+static void bq_carry_paced(struct adios_data *ad) {
+	u8 next = (ad->bq_page + 1) % ADIOS_BQ_PAGES;
+
+	list_splice_init(&ad->batch_queue[ad->bq_page][ADIOS_WRITE],
+		&ad->batch_queue[next][ADIOS_WRITE]);
+	flip_bq_page(ad);
+}
+
 // Dispatch a request from the batch queues
-static struct request *dispatch_from_bq(struct adios_data *ad) {
+static struct request *dispatch_from_bq(
+		struct adios_data *ad, struct blk_mq_hw_ctx *hctx) {
 	struct request *rq = NULL;
-	u64 tpl;
+	bool paced = false;
+	u64 tpl, now = 0;
 
 	guard(spinlock_irqsave)(&ad->bq_lock);
 
 	tpl = atomic64_read(&ad->total_pred_lat);
 
-	if (!ad->more_bq_ready && (!tpl ||
-			tpl < ad->global_latency_window * ad->bq_refill_below_ratio / 100))
-		fill_batch_queues(ad, tpl);
+	if (!ad->more_bq_ready && bq_refill_allowed(ad, tpl) &&
+			fill_batch_queues(ad, tpl))
+		adios_info_publish(ad);
+
+	if (ad->write_pacing)
+		now = ktime_get_ns();
 
 again:
 	// Check if there are any requests in the batch queues
-	for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
-		if (!list_empty(&ad->batch_queue[ad->bq_page][i])) {
-			rq = list_first_entry(&ad->batch_queue[ad->bq_page][i],
-									struct request, queuelist);
-			list_del_init(&rq->queuelist);
+	rq = pop_from_bq_page(ad, hctx, ad->bq_page, now, &paced);
+	if (rq)
+		return rq;
+
+	if (ad->more_bq_ready) {
+		// If there's more batch queue page available, flip to it and retry
+		if (!paced) {
+			flip_bq_page(ad);
+			goto again;
+		}
+
+		// Let the next page's other requests overtake the paced writes
+		rq = pop_from_bq_page(
+			ad, hctx, (ad->bq_page + 1) % ADIOS_BQ_PAGES, now, &paced);
+		if (rq)
 			return rq;
+
+		// Only paced writes are left; do not let them block refilling
+		bq_carry_paced(ad);
+		if (bq_refill_allowed(ad, tpl) && fill_batch_queues(ad, tpl)) {
+			adios_info_publish(ad);
+			goto again;
 		}
 	}
 
-	// If there's more batch queue page available, flip to it and retry
-	if (ad->more_bq_ready) {
-		flip_bq_page(ad);
-		goto again;
+	if (paced)
+		adios_kick_at(ad, ad->next_write_ns);
+
+	// Queued requests cannot be batched yet; wait for budget to free up
+	if (READ_ONCE(ad->dl_queued)) {
+		WRITE_ONCE(ad->throttled, true);
+
+		// Completions that freed the budget before the flag was set saw
+		// the queue unthrottled and did not kick it; pairs with the
+		// barrier in adios_completed_request()
+		smp_mb();
+		if (bq_refill_allowed(ad, atomic64_read(&ad->total_pred_lat))) {
+			WRITE_ONCE(ad->throttled, false);
+			blk_mq_run_hw_queues(ad->queue, true);
+			return NULL;
+		}
+
+		// has_work hides the queued requests, so the fallback run has
+		// to clear the flag itself; the dispatch timer does that
+		adios_kick_at(ad, ktime_get_ns() +
+			ADIOS_THROTTLE_RERUN_MS * NSEC_PER_MSEC);
 	}
 
 	return NULL;
@@ -860,35 +1955,200 @@ static struct request *adios_dispatch_request(struct blk_mq_hw_ctx *hctx) {
 
 	rq = dispatch_from_pq(ad);
 	if (rq) goto found;
-	rq = dispatch_from_bq(ad);
+	rq = dispatch_from_bq(ad, hctx);
 	if (!rq) return NULL;
 found:
 	rq->rq_flags |= RQF_STARTED;
 	return rq;
 }
 
-// Timer callback function to periodically update latency models
-static void update_timer_callback(struct timer_list *t) {
-	struct adios_data *ad = from_timer(ad, t, update_timer);
+// Seed models that have not learned anything yet from the shared group
+static void model_group_seed(struct adios_data *ad) {
+	struct adios_model_group *group = ad->model_group;
+
+	lockdep_assert_held(&adios_model_groups_lock);
+
+	if (!group)
+		return;
+
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
+		struct latency_model *model = &ad->latency_model[i];
+
+		guard(spinlock_irqsave)(&model->lock);
+		if (model->base || !group->base[i])
+			continue;
+		model->base = group->base[i];
+		model->slope = group->slope[i];
+		lm_bump_gen(model);
+	}
+}
+
+// Blend well-trained models into the shared group and seed cold ones
+static void model_group_contribute(struct adios_data *ad) {
+	struct adios_model_group *group;
+
+	guard(spinlock_irqsave)(&adios_model_groups_lock);
+
+	group = ad->model_group;
+	if (!group)
+		return;
+
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
+		struct latency_model *model = &ad->latency_model[i];
+
+		guard(spinlock_irqsave)(&model->lock);
+		if (model->small_count < LM_SAMPLES_THRESHOLD || !model->base)
+			continue;
+		group->base[i] = group->base[i] ?
+			(group->base[i] * 3 + model->base) >> 2 : model->base;
+		if (model->slope)
+			group->slope[i] = group->slope[i] ?
+				(group->slope[i] * 3 + model->slope) >> 2 : model->slope;
+	}
+
+	model_group_seed(ad);
+}
+
+// Leave the current model group, returning it if it became unused
+static struct adios_model_group *model_group_leave(struct adios_data *ad) {
+	struct adios_model_group *group = ad->model_group;
+
+	lockdep_assert_held(&adios_model_groups_lock);
+
+	ad->model_group = NULL;
+	if (!group || --group->refs)
+		return NULL;
+
+	list_del(&group->node);
+	return group;
+}
+
+// Join the model group with the given name, creating it if needed
+static int model_group_join(struct adios_data *ad, const char *name) {
+	struct adios_model_group *group, *pos, *new, *old;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+	strscpy(new->name, name, sizeof(new->name));
+
+	scoped_guard(spinlock_irqsave, &adios_model_groups_lock) {
+		old = model_group_leave(ad);
+
+		group = NULL;
+		list_for_each_entry(pos, &adios_model_groups, node) {
+			if (!strcmp(pos->name, new->name)) {
+				group = pos;
+				break;
+			}
+		}
+		if (!group) {
+			group = new;
+			new = NULL;
+			list_add_tail(&group->node, &adios_model_groups);
+		}
+
+		group->refs++;
+		ad->model_group = group;
+		model_group_seed(ad);
+	}
+
+	kfree(old);
+	kfree(new);
+	return 0;
+}
+
+// Worker to update the latency models of active instances
+static void adios_update_workfn(struct work_struct *work) {
+	LIST_HEAD(pending);
+	struct adios_data *ad;
+
+	scoped_guard(spinlock_irqsave, &adios_update_lock)
+		list_splice_init(&adios_update_list, &pending);
+
+	// Take one instance at a time so that exit can still unlink the rest
+	for (;;) {
+		scoped_guard(spinlock_irqsave, &adios_update_lock) {
+			ad = list_first_entry_or_null(&pending,
+				struct adios_data, update_node);
+			if (ad)
+				list_del_init(&ad->update_node);
+		}
+		if (!ad)
+			break;
+
+		for (u8 optype = 0; optype < ADIOS_OPTYPES; optype++)
+			latency_model_update(&ad->latency_model[optype]);
+
+		model_group_contribute(ad);
+		adios_info_publish(ad);
+	}
+}
+
+// Schedule a coalesced latency model update for an instance
+static void queue_model_update(struct adios_data *ad) {
+	unsigned long flags;
+
+	if (!list_empty_careful(&ad->update_node))
+		return;
+
+	spin_lock_irqsave(&adios_update_lock, flags);
+	if (list_empty(&ad->update_node))
+		list_add_tail(&ad->update_node, &adios_update_list);
+	spin_unlock_irqrestore(&adios_update_lock, flags);
 
-	for (u8 optype = 0; optype < ADIOS_OPTYPES; optype++)
-		latency_model_update(&ad->latency_model[optype]);
+	queue_delayed_work(system_unbound_wq, &adios_update_work,
+		msecs_to_jiffies(100));
 }
 
 // Handle the completion of a request
 static void adios_completed_request(struct request *rq, u64 now) {
 	struct adios_data *ad = rq->q->elevator->elevator_data;
 	struct adios_rq_data *rd = get_rq_data(rq);
+	u8 optype = adios_optype(rq);
+
+	atomic64_sub(rd->plan_lat, &ad->total_pred_lat);
+	atomic64_sub(rd->plan_lat, &ad->optype_pred_lat[optype]);
+
+	// Re-kick a throttled queue once the budget allows refilling again.
+	// Order the budget update before reading the flag, see dispatch_from_bq().
+	smp_mb__after_atomic();
+	if (READ_ONCE(ad->throttled) &&
+			bq_refill_allowed(ad, atomic64_read(&ad->total_pred_lat))) {
+		WRITE_ONCE(ad->throttled, false);
+		blk_mq_run_hw_queues(rq->q, true);
+	}
+
+	batch_stat_complete(ad, rd, now);
 
-	atomic64_sub(rd->pred_lat, &ad->total_pred_lat);
+	adios_info_publish_backlog(ad);
 
 	if (!rq->io_start_time_ns || !rd->block_size)
 		return;
+
+	// Account the completion to the request's partition
+	struct adios_part *part = adios_rq_part(ad, rq);
+	if (part) {
+		atomic64_inc(&part->count[optype]);
+		atomic64_add(now - rq->start_time_ns, &part->sum_lat[optype]);
+	}
+
+	if (adios_rq_swapin(rq)) {
+		u64 swap_lat = now - rq->start_time_ns;
+		u64 swap_target = READ_ONCE(ad->swap_target);
+
+		atomic64_inc(&ad->swap_count);
+		atomic64_add(swap_lat, &ad->swap_sum_lat);
+		if (swap_target && swap_lat > swap_target)
+			atomic64_inc(&ad->swap_missed);
+	}
+
 	u64 latency = now - rq->io_start_time_ns;
-	u8 optype = adios_optype(rq);
 	latency_model_input(&ad->latency_model[optype],
 		rd->block_size, latency, rd->pred_lat);
-	timer_reduce(&ad->update_timer, jiffies + msecs_to_jiffies(100));
+	if (optype == ADIOS_WRITE)
+		write_hint_input(ad, rq, latency, rd->pred_lat);
+	queue_model_update(ad);
 }
 
 // Clean up after a request is finished
@@ -918,10 +2178,53 @@ static inline bool bq_has_work(struct adios_data *ad) {
 }
 
 static inline bool dl_tree_has_work(struct adios_data *ad) {
+	// Queued requests are not dispatchable while the batch is throttled
+	if (READ_ONCE(ad->throttled))
+		return false;
+
 	guard(spinlock_irqsave)(&ad->lock);
 	return ad->dl_queued;
 }
 
+// Predict the completion latency of a hypothetical request, backlog included
+static u64 adios_predict_completion(
+		struct adios_data *ad, u8 optype, u32 bytes) {
+	bool dl_idx = optype != ADIOS_READ;
+	u64 backlog;
+
+	// Everything in flight, plus what waits in the same deadline tree
+	backlog = atomic64_read(&ad->total_pred_lat);
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++)
+		if ((i != ADIOS_READ) == dl_idx)
+			backlog += READ_ONCE(ad->queued_pred_lat[i]);
+
+	// The device works through the backlog with its learned parallelism,
+	// whether or not the batch window is scaled by it
+	backlog = div_u64(backlog * PAR_ONE, READ_ONCE(ad->parallelism));
+
+	return backlog + latency_model_plan(ad, optype,
+		latency_model_predict(&ad->latency_model[optype], bytes));
+}
+
+static struct elevator_type mq_adios;
+
+// Predict the completion latency of a hypothetical request on an ADIOS queue
+u64 adios_predict_latency(struct request_queue *q, enum req_op op, u32 bytes) {
+	u64 lat = 0;
+
+	// Pin the queue so that the elevator cannot be switched underneath us
+	if (!percpu_ref_tryget_live(&q->q_usage_counter))
+		return 0;
+
+	if (q->elevator && q->elevator->type == &mq_adios)
+		lat = adios_predict_completion(q->elevator->elevator_data,
+			adios_opf_optype((__force blk_opf_t)op), bytes);
+
+	percpu_ref_put(&q->q_usage_counter);
+	return lat;
+}
+EXPORT_SYMBOL_GPL(adios_predict_latency);
+
 // Check if there are any requests available for dispatch
 static bool adios_has_work(struct blk_mq_hw_ctx *hctx) {
 	struct adios_data *ad = hctx->queue->elevator->elevator_data;
@@ -935,6 +2238,88 @@ static int adios_init_hctx(struct blk_mq_hw_ctx *hctx, unsigned int hctx_idx) {
 	return 0;
 }
 
+// Open the latency predictor page and start keeping it up to date
+static int adios_info_open(struct inode *inode, struct file *file) {
+	struct dentry *dentry = file->f_path.dentry;
+	struct adios_data *ad = inode->i_private;
+	int ret;
+
+	ret = debugfs_file_get(dentry);
+	if (ret)
+		return ret;
+	file->private_data = ad;
+	atomic_inc(&ad->info_users);
+	adios_info_publish(ad);
+	debugfs_file_put(dentry);
+
+	return 0;
+}
+
+// Stop keeping the page up to date once its last user is gone
+static int adios_info_release(struct inode *inode, struct file *file) {
+	struct dentry *dentry = file->f_path.dentry;
+	struct adios_data *ad = file->private_data;
+
+	// The scheduler may be gone already, taking the count with it
+	if (debugfs_file_get(dentry))
+		return 0;
+	atomic_dec(&ad->info_users);
+	debugfs_file_put(dentry);
+
+	return 0;
+}
+
+// Map the latency predictor page read-only into userspace
+static int adios_info_mmap(struct file *file, struct vm_area_struct *vma) {
+	struct dentry *dentry = file->f_path.dentry;
+	struct adios_data *ad = file->private_data;
+	int ret;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	// The page outlives the scheduler through the mapping's reference
+	ret = debugfs_file_get(dentry);
+	if (ret)
+		return ret;
+	vm_flags_mod(vma, VM_DONTEXPAND | VM_DONTDUMP, VM_MAYWRITE);
+	ret = vm_insert_page(vma, vma->vm_start, ad->info_page);
+	debugfs_file_put(dentry);
+
+	return ret;
+}
+
+// Read a snapshot of the latency predictor page
+static ssize_t adios_info_read(
+		struct file *file, char __user *buf, size_t count, loff_t *ppos) {
+	struct dentry *dentry = file->f_path.dentry;
+	struct adios_data *ad = file->private_data;
+	struct adios_info_page snap;
+	unsigned long flags;
+	ssize_t ret;
+
+	ret = debugfs_file_get(dentry);
+	if (ret)
+		return ret;
+	spin_lock_irqsave(&ad->info_lock, flags);
+	snap = *ad->info;
+	spin_unlock_irqrestore(&ad->info_lock, flags);
+	debugfs_file_put(dentry);
+
+	return simple_read_from_buffer(buf, count, ppos, &snap, sizeof(snap));
+}
+
+static const struct file_operations adios_info_fops = {
+	.owner  = THIS_MODULE,
+	.open    = adios_info_open,
+	.release = adios_info_release,
+	.read    = adios_info_read,
+	.mmap    = adios_info_mmap,
+	.llseek  = default_llseek,
+};
+
 // Initialize the scheduler-specific data when initializing the request queue
 static int adios_init_sched(struct request_queue *q, struct elevator_type *e) {
 	struct adios_data *ad;
@@ -967,12 +2352,28 @@ static int adios_init_sched(struct request_queue *q, struct elevator_type *e) {
 		goto destroy_rq_data_pool;
 	}
 
+	ad->info_page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (!ad->info_page)
+		goto destroy_dl_group_pool;
+	ad->info = page_address(ad->info_page);
+	ad->info->version = ADIOS_INFO_VERSION;
+	spin_lock_init(&ad->info_lock);
+
 	eq->elevator_data = ad;
 	
 	ad->global_latency_window = default_global_latency_window;
 	ad->bq_refill_below_ratio = default_bq_refill_below_ratio;
+	ad->fast_path_ratio = default_fast_path_ratio;
+	ad->parallelism = PAR_ONE;
+	ad->dispatch_locality = true;
+	ad->lat_sigma_k = default_lat_sigma_k;
+	ad->write_pacing = default_write_pacing;
+	ad->write_merge_delay = default_write_merge_delay;
+	ad->write_align_hold = default_write_align_hold;
+	ad->queue = q;
 
 	INIT_LIST_HEAD(&ad->prio_queue);
+	INIT_LIST_HEAD(&ad->held_rqs);
 	for (u8 i = 0; i < 2; i++)
 		ad->dl_tree[i] = RB_ROOT_CACHED;
 	ad->dl_bias = 0;
@@ -992,11 +2393,23 @@ static int adios_init_sched(struct request_queue *q, struct elevator_type *e) {
 		model->lm_shrink_at_kreqs  = default_lm_shrink_at_kreqs;
 		model->lm_shrink_at_gbytes = default_lm_shrink_at_gbytes;
 		model->lm_shrink_resist    = default_lm_shrink_resist;
+		model->bootstrap           = default_lat_bootstrap;
 
 		ad->latency_target[i] = default_latency_target[i];
+		ad->latency_window[i] = default_latency_window[i];
+		ad->nowait_backlog[i] = default_nowait_backlog[i];
+		ad->throttle_backlog[i] = default_throttle_backlog[i];
 		ad->batch_limit[i] = default_batch_limit[i];
 	}
-	timer_setup(&ad->update_timer, update_timer_callback, 0);
+	for (u8 i = 0; i < ADIOS_CDL_LEVELS; i++)
+		ad->cdl_target[i] = default_cdl_target[i];
+	ad->swap_target = default_swap_target;
+	ad->swap_prio = default_swap_prio;
+	for (u8 i = 0; i < ADIOS_WRITE_HINTS; i++)
+		ad->write_hint_cost[i] = WH_COST_ONE;
+	INIT_LIST_HEAD(&ad->update_node);
+	hrtimer_init(&ad->dispatch_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	ad->dispatch_timer.function = adios_dispatch_timer_fn;
 	init_batch_queues(ad);
 
 	spin_lock_init(&ad->lock);
@@ -1006,9 +2419,14 @@ static int adios_init_sched(struct request_queue *q, struct elevator_type *e) {
 	/* We dispatch from request queue wide instead of hw queue */
 	blk_queue_flag_set(QUEUE_FLAG_SQ_SCHED, q);
 
+	ad->info_dentry = debugfs_create_file_unsafe(q->disk->disk_name, 0444,
+		adios_debugfs_root, ad, &adios_info_fops);
+
 	q->elevator = eq;
 	return 0;
 
+destroy_dl_group_pool:
+	kmem_cache_destroy(ad->dl_group_pool);
 destroy_rq_data_pool:
 	kmem_cache_destroy(ad->rq_data_pool);
 free_ad:
@@ -1022,9 +2440,21 @@ put_eq:
 static void adios_exit_sched(struct elevator_queue *e) {
 	struct adios_data *ad = e->elevator_data;
 
-	timer_shutdown_sync(&ad->update_timer);
+	// The instance may sit on the update worker's private list, which is
+	// only touched under adios_update_lock, or be updated right now
+	scoped_guard(spinlock_irqsave, &adios_update_lock)
+		list_del_init(&ad->update_node);
+	flush_delayed_work(&adios_update_work);
+	hrtimer_cancel(&ad->dispatch_timer);
+	debugfs_remove(ad->info_dentry);
+	// Existing mappings keep their own reference to the page
+	__free_page(ad->info_page);
+
+	scoped_guard(spinlock_irqsave, &adios_model_groups_lock)
+		kfree(model_group_leave(ad));
 
 	WARN_ON_ONCE(!list_empty(&ad->prio_queue));
+	WARN_ON_ONCE(!list_empty(&ad->held_rqs));
 
 	if (ad->rq_data_pool)
 		kmem_cache_destroy(ad->rq_data_pool);
@@ -1045,6 +2475,7 @@ static ssize_t adios_lat_model_##name##_show(				\
 	guard(spinlock_irqsave)(&model->lock);				\
 	len += sprintf(page,       "base : %llu ns\n", model->base);	\
 	len += sprintf(page + len, "slope: %llu ns/KiB\n", model->slope);\
+	len += sprintf(page + len, "sigma: %llu ns\n", model->stddev);	\
 	return len;							\
 }									\
 static ssize_t adios_lat_target_##name##_store(				\
@@ -1055,8 +2486,12 @@ static ssize_t adios_lat_target_##name##_store(				\
 	ret = kstrtoul(page, 10, &nsec);					\
 	if (ret)							\
 		return ret;						\
+	lm_bootstrap_seed(&ad->latency_model[optype]);			\
 	ad->latency_model[optype].base = 0ULL;				\
 	ad->latency_target[optype] = nsec;				\
+	lm_bump_gen(&ad->latency_model[optype]);			\
+	scoped_guard(spinlock_irqsave, &adios_model_groups_lock)	\
+		model_group_seed(ad);					\
 	return count;							\
 }									\
 static ssize_t adios_lat_target_##name##_show(				\
@@ -1079,26 +2514,103 @@ static ssize_t adios_batch_limit_##name##_show(				\
 		struct elevator_queue *e, char *page) {				\
 	struct adios_data *ad = e->elevator_data;				\
 	return sprintf(page, "%u\n", ad->batch_limit[optype]);		\
+}									\
+static ssize_t adios_latency_window_##name##_store(			\
+		struct elevator_queue *e, const char *page, size_t count) {	\
+	struct adios_data *ad = e->elevator_data;				\
+	unsigned long nsec;						\
+	int ret;							\
+	ret = kstrtoul(page, 10, &nsec);					\
+	if (ret)							\
+		return ret;						\
+	ad->latency_window[optype] = nsec;				\
+	return count;							\
+}									\
+static ssize_t adios_latency_window_##name##_show(			\
+		struct elevator_queue *e, char *page) {				\
+	struct adios_data *ad = e->elevator_data;				\
+	return sprintf(page, "%llu\n", ad->latency_window[optype]);	\
+}									\
+static ssize_t adios_nowait_backlog_##name##_store(			\
+		struct elevator_queue *e, const char *page, size_t count) {	\
+	struct adios_data *ad = e->elevator_data;				\
+	unsigned long nsec;						\
+	int ret;							\
+	ret = kstrtoul(page, 10, &nsec);					\
+	if (ret)							\
+		return ret;						\
+	ad->nowait_backlog[optype] = nsec;				\
+	return count;							\
+}									\
+static ssize_t adios_nowait_backlog_##name##_show(			\
+		struct elevator_queue *e, char *page) {				\
+	struct adios_data *ad = e->elevator_data;				\
+	return sprintf(page, "%llu\n", ad->nowait_backlog[optype]);	\
+}									\
+static ssize_t adios_throttle_backlog_##name##_store(			\
+		struct elevator_queue *e, const char *page, size_t count) {	\
+	struct adios_data *ad = e->elevator_data;				\
+	unsigned long nsec;						\
+	int ret;							\
+	ret = kstrtoul(page, 10, &nsec);					\
+	if (ret)							\
+		return ret;						\
+	ad->throttle_backlog[optype] = nsec;				\
+	return count;							\
+}									\
+static ssize_t adios_throttle_backlog_##name##_show(			\
+		struct elevator_queue *e, char *page) {				\
+	struct adios_data *ad = e->elevator_data;				\
+	return sprintf(page, "%llu\n", ad->throttle_backlog[optype]);	\
 }
 
 SYSFS_OPTYPE_DECL(read, ADIOS_READ);
 SYSFS_OPTYPE_DECL(write, ADIOS_WRITE);
 SYSFS_OPTYPE_DECL(discard, ADIOS_DISCARD);
+SYSFS_OPTYPE_DECL(other, ADIOS_OTHER);
+
+// Define sysfs attributes for duration limit hint targets
+#define CDL_TARGET_ATTR_RW(level)					\
+static ssize_t adios_cdl_target_##level##_store(			\
+		struct elevator_queue *e, const char *page, size_t count) {	\
+	struct adios_data *ad = e->elevator_data;				\
+	unsigned long nsec;						\
+	int ret;							\
+	ret = kstrtoul(page, 10, &nsec);					\
+	if (ret)							\
+		return ret;						\
+	WRITE_ONCE(ad->cdl_target[level], nsec);			\
+	return count;							\
+}									\
+static ssize_t adios_cdl_target_##level##_show(				\
+		struct elevator_queue *e, char *page) {				\
+	struct adios_data *ad = e->elevator_data;				\
+	return sprintf(page, "%llu\n", READ_ONCE(ad->cdl_target[level]));	\
+}
+
+CDL_TARGET_ATTR_RW(1)
+CDL_TARGET_ATTR_RW(2)
+CDL_TARGET_ATTR_RW(3)
+CDL_TARGET_ATTR_RW(4)
+CDL_TARGET_ATTR_RW(5)
+CDL_TARGET_ATTR_RW(6)
+CDL_TARGET_ATTR_RW(7)
 
 // Show the maximum batch size actually achieved for each operation type
 static ssize_t adios_batch_actual_max_show(
 		struct elevator_queue *e, char *page) {
 	struct adios_data *ad = e->elevator_data;
-	u32 total_count, read_count, write_count, discard_count;
+	u32 total_count, read_count, write_count, discard_count, other_count;
 
 	total_count = ad->batch_actual_max_total;
 	read_count = ad->batch_actual_max_size[ADIOS_READ];
 	write_count = ad->batch_actual_max_size[ADIOS_WRITE];
 	discard_count = ad->batch_actual_max_size[ADIOS_DISCARD];
+	other_count = ad->batch_actual_max_size[ADIOS_OTHER];
 
 	return sprintf(page,
-		"Total  : %u\nDiscard: %u\nRead   : %u\nWrite  : %u\n",
-		total_count, discard_count, read_count, write_count);
+		"Total  : %u\nDiscard: %u\nRead   : %u\nWrite  : %u\nOther  : %u\n",
+		total_count, discard_count, read_count, write_count, other_count);
 }
 
 // Set the global latency window
@@ -1147,15 +2659,284 @@ static ssize_t adios_bq_refill_below_ratio_store(
 	return count;
 }
 
-// Show the read priority
-static ssize_t adios_read_priority_show(
+// Show the k·σ safety margin factor
+static ssize_t adios_lat_sigma_k_show(
 		struct elevator_queue *e, char *page) {
 	struct adios_data *ad = e->elevator_data;
-	return sprintf(page, "%d\n", ad->dl_prio[0]);
+	return sprintf(page, "%u\n", ad->lat_sigma_k);
 }
 
-// Set the read priority
-static ssize_t adios_read_priority_store(
+// Set the k·σ safety margin factor (in hundredths of a standard deviation)
+static ssize_t adios_lat_sigma_k_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	unsigned int k;
+	int ret;
+
+	ret = kstrtouint(page, 10, &k);
+	if (ret || k > 1000)
+		return -EINVAL;
+
+	ad->lat_sigma_k = k;
+
+	return count;
+}
+
+// Show the write pacing ratio
+static ssize_t adios_write_pacing_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%u\n", ad->write_pacing);
+}
+
+// Set the write pacing ratio (percent of predicted write latency, 0: off)
+static ssize_t adios_write_pacing_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	unsigned int ratio;
+	int ret;
+
+	ret = kstrtouint(page, 10, &ratio);
+	if (ret || ratio > 1000)
+		return -EINVAL;
+
+	ad->write_pacing = ratio;
+
+	return count;
+}
+
+// Show the async write merge delay
+static ssize_t adios_write_merge_delay_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%llu\n", READ_ONCE(ad->write_merge_delay));
+}
+
+// Set the async write merge delay
+static ssize_t adios_write_merge_delay_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	u64 nsec;
+	int ret;
+
+	ret = kstrtou64(page, 10, &nsec);
+	if (ret || nsec > ADIOS_WRITE_MERGE_DELAY_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(ad->write_merge_delay, nsec);
+
+	return count;
+}
+
+// Show the time partial-unit async writes are held
+static ssize_t adios_write_align_hold_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%llu\n", READ_ONCE(ad->write_align_hold));
+}
+
+// Set the time partial-unit async writes are held
+static ssize_t adios_write_align_hold_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	u64 nsec;
+	int ret;
+
+	ret = kstrtou64(page, 10, &nsec);
+	if (ret || nsec > ADIOS_WRITE_ALIGN_HOLD_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(ad->write_align_hold, nsec);
+
+	return count;
+}
+
+// Show the write unit used for alignment
+static ssize_t adios_write_align_unit_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%u\n", write_align_unit(ad->queue));
+}
+
+// Show whether batched writes are grouped by lifetime hint
+static ssize_t adios_write_hint_group_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%d\n", ad->write_hint_group);
+}
+
+// Enable or disable grouping of batched writes by lifetime hint
+static ssize_t adios_write_hint_group_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	bool val;
+	int ret;
+
+	ret = kstrtobool(page, &val);
+	if (ret)
+		return -EINVAL;
+
+	ad->write_hint_group = val;
+
+	return count;
+}
+
+// Show whether learned per-hint write costs are applied
+static ssize_t adios_write_hint_learn_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%d\n", ad->write_hint_learn);
+}
+
+// Enable or disable applying learned per-hint write costs
+static ssize_t adios_write_hint_learn_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	bool val;
+	int ret;
+
+	ret = kstrtobool(page, &val);
+	if (ret)
+		return -EINVAL;
+
+	ad->write_hint_learn = val;
+
+	return count;
+}
+
+// Show the learned relative write cost of each lifetime hint
+static ssize_t adios_write_hint_cost_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	ssize_t len = 0;
+
+	for (u8 i = 0; i < ADIOS_WRITE_HINTS; i++)
+		len += sprintf(page + len, "hint %u: %u/%u\n", i,
+			READ_ONCE(ad->write_hint_cost[i]), WH_COST_ONE);
+	return len;
+}
+
+// Show whether least-laxity ordering is enabled
+static ssize_t adios_least_laxity_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%d\n", ad->least_laxity);
+}
+
+// Switch between earliest-deadline and least-laxity ordering
+static ssize_t adios_least_laxity_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	bool val;
+	int ret;
+
+	ret = kstrtobool(page, &val);
+	if (ret)
+		return -EINVAL;
+
+	guard(spinlock_irqsave)(&ad->lock);
+	if (ad->least_laxity == val)
+		return count;
+	ad->least_laxity = val;
+
+	// Have queued requests re-keyed lazily as they reach the front
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
+		struct latency_model *model = &ad->latency_model[i];
+		scoped_guard(spinlock_irqsave, &model->lock)
+			lm_bump_gen(model);
+	}
+
+	return count;
+}
+
+// Show the fast_path_ratio
+static ssize_t adios_fast_path_ratio_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%d\n", ad->fast_path_ratio);
+}
+
+// Set the fast_path_ratio
+static ssize_t adios_fast_path_ratio_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	int ratio;
+	int ret;
+
+	ret = kstrtoint(page, 10, &ratio);
+	if (ret || ratio < 0 || ratio > 100)
+		return -EINVAL;
+
+	ad->fast_path_ratio = ratio;
+
+	return count;
+}
+
+// Show the learned effective device parallelism
+static ssize_t adios_parallelism_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	u32 par = READ_ONCE(ad->parallelism);
+
+	return sprintf(page, "%u.%02u\n",
+		par / PAR_ONE, (par % PAR_ONE) * 100 / PAR_ONE);
+}
+
+// Show whether window admission is scaled by the learned parallelism
+static ssize_t adios_parallelism_scaling_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%d\n", ad->parallelism_scaling);
+}
+
+// Enable or disable scaling window admission by the learned parallelism
+static ssize_t adios_parallelism_scaling_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	bool val;
+	int ret;
+
+	ret = kstrtobool(page, &val);
+	if (ret)
+		return -EINVAL;
+
+	ad->parallelism_scaling = val;
+
+	return count;
+}
+
+// Show whether dispatch prefers requests submitted through the running hctx
+static ssize_t adios_dispatch_locality_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%d\n", ad->dispatch_locality);
+}
+
+// Enable or disable hctx-local preference when dispatching batches
+static ssize_t adios_dispatch_locality_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	bool val;
+	int ret;
+
+	ret = kstrtobool(page, &val);
+	if (ret)
+		return -EINVAL;
+
+	ad->dispatch_locality = val;
+
+	return count;
+}
+
+// Show the read priority
+static ssize_t adios_read_priority_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%d\n", ad->dl_prio[0]);
+}
+
+// Set the read priority
+static ssize_t adios_read_priority_store(
 		struct elevator_queue *e, const char *page, size_t count) {
 	struct adios_data *ad = e->elevator_data;
 	int prio;
@@ -1172,6 +2953,191 @@ static ssize_t adios_read_priority_store(
 	return count;
 }
 
+// Show the latency target for swap-in reads
+static ssize_t adios_lat_target_swap_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%llu\n", READ_ONCE(ad->swap_target));
+}
+
+// Set the latency target for swap-in reads
+static ssize_t adios_lat_target_swap_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	unsigned long nsec;
+	int ret;
+
+	ret = kstrtoul(page, 10, &nsec);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(ad->swap_target, nsec);
+
+	return count;
+}
+
+// Show the swap-in read priority
+static ssize_t adios_swap_priority_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%d\n", ad->swap_prio);
+}
+
+// Set the swap-in read priority
+static ssize_t adios_swap_priority_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	int prio;
+	int ret;
+
+	ret = kstrtoint(page, 10, &prio);
+	if (ret || prio < -20 || prio > 19)
+		return -EINVAL;
+
+	guard(spinlock_irqsave)(&ad->lock);
+	ad->swap_prio = prio;
+
+	return count;
+}
+
+// Show the swap-in read completion statistics
+static ssize_t adios_swap_stats_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	u64 nr = atomic64_read(&ad->swap_count);
+	u64 sum = atomic64_read(&ad->swap_sum_lat);
+	ssize_t len = 0;
+
+	len += sprintf(page,       "count  : %llu\n", nr);
+	len += sprintf(page + len, "avg lat: %llu ns\n", nr ? div64_u64(sum, nr) : 0);
+	len += sprintf(page + len, "missed : %llu\n",
+		atomic64_read(&ad->swap_missed));
+	return len;
+}
+
+static const char * const adios_part_optype_names[] = {
+	[ADIOS_READ]    = "read",
+	[ADIOS_WRITE]   = "write",
+	[ADIOS_DISCARD] = "discard",
+	[ADIOS_OTHER]   = "other",
+};
+
+// Show the per-partition latency target and priority overrides
+static ssize_t adios_part_target_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	ssize_t len = 0;
+
+	for (u8 i = 0; i < ADIOS_PARTS; i++) {
+		struct adios_part *part = &ad->part[i];
+		bool set = part->prio_set;
+
+		for (u8 j = 0; j < ARRAY_SIZE(adios_part_optype_names); j++)
+			set |= !!READ_ONCE(part->latency_target[j]);
+		if (!set)
+			continue;
+
+		len += sprintf(page + len, "part%u:", i);
+		for (u8 j = 0; j < ARRAY_SIZE(adios_part_optype_names); j++)
+			len += sprintf(page + len, " %s %llu",
+				adios_part_optype_names[j],
+				READ_ONCE(part->latency_target[j]));
+		if (part->prio_set)
+			len += sprintf(page + len, " prio %d\n", part->prio);
+		else
+			len += sprintf(page + len, " prio -\n");
+	}
+	return len;
+}
+
+// Set a per-partition override: "<partno> <read|write|discard|other|prio> <value|->"
+static ssize_t adios_part_target_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	struct adios_part *part;
+	char key[8], val[24];
+	unsigned int partno;
+	u64 nsec;
+	int prio;
+
+	if (sscanf(page, "%u %7s %23s", &partno, key, val) != 3 ||
+			partno >= ADIOS_PARTS)
+		return -EINVAL;
+	part = &ad->part[partno];
+
+	if (!strcmp(key, "prio")) {
+		guard(spinlock_irqsave)(&ad->lock);
+		if (!strcmp(val, "-")) {
+			part->prio_set = false;
+			return count;
+		}
+		if (kstrtoint(val, 10, &prio) || prio < -20 || prio > 19)
+			return -EINVAL;
+		part->prio = prio;
+		part->prio_set = true;
+		return count;
+	}
+
+	for (u8 j = 0; j < ARRAY_SIZE(adios_part_optype_names); j++) {
+		if (strcmp(key, adios_part_optype_names[j]))
+			continue;
+		if (!strcmp(val, "-"))
+			nsec = 0;
+		else if (kstrtou64(val, 10, &nsec))
+			return -EINVAL;
+		WRITE_ONCE(part->latency_target[j], nsec);
+		return count;
+	}
+
+	return -EINVAL;
+}
+
+// Show the per-partition completion statistics
+static ssize_t adios_part_stats_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	ssize_t len = 0;
+
+	for (u8 i = 0; i < ADIOS_PARTS; i++) {
+		struct adios_part *part = &ad->part[i];
+		u64 nr[ADIOS_OPTYPES], total = 0;
+
+		for (u8 j = 0; j < ARRAY_SIZE(adios_part_optype_names); j++)
+			total += nr[j] = atomic64_read(&part->count[j]);
+		if (!total)
+			continue;
+
+		len += sprintf(page + len, "part%u:", i);
+		for (u8 j = 0; j < ARRAY_SIZE(adios_part_optype_names); j++) {
+			u64 sum = atomic64_read(&part->sum_lat[j]);
+			len += sprintf(page + len, " %s %llu/%llu ns",
+				adios_part_optype_names[j], nr[j],
+				nr[j] ? div64_u64(sum, nr[j]) : 0);
+		}
+		len += sprintf(page + len, "\n");
+	}
+	return len;
+}
+
+// Show the predicted completion latency of typical requests
+static ssize_t adios_predicted_latency_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	static const char * const names[] = {
+		[ADIOS_READ]    = "Read",
+		[ADIOS_WRITE]   = "Write",
+		[ADIOS_DISCARD] = "Discard",
+		[ADIOS_OTHER]   = "Other",
+	};
+	ssize_t len = 0;
+
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++)
+		len += sprintf(page + len, "%-7s: %llu ns (4KiB), %llu ns (128KiB)\n",
+			names[i], adios_predict_completion(ad, i, 4096),
+			adios_predict_completion(ad, i, 131072));
+	return len;
+}
+
 // Reset batch queue statistics
 static ssize_t adios_reset_bq_stats_store(
 		struct elevator_queue *e, const char *page, size_t count) {
@@ -1188,6 +3154,17 @@ static ssize_t adios_reset_bq_stats_store(
 
 	ad->batch_actual_max_total = 0;
 
+	atomic64_set(&ad->swap_count, 0);
+	atomic64_set(&ad->swap_sum_lat, 0);
+	atomic64_set(&ad->swap_missed, 0);
+
+	for (u8 i = 0; i < ADIOS_PARTS; i++) {
+		for (u8 j = 0; j < ADIOS_OPTYPES; j++) {
+			atomic64_set(&ad->part[i].count[j], 0);
+			atomic64_set(&ad->part[i].sum_lat[j], 0);
+		}
+	}
+
 	return count;
 }
 
@@ -1206,15 +3183,60 @@ static ssize_t adios_reset_lat_model_store(
 		struct latency_model *model = &ad->latency_model[i];
 		unsigned long flags;
 		spin_lock_irqsave(&model->lock, flags);
+		lm_bootstrap_seed(model);
 		model->base = 0ULL;
 		model->slope = 0ULL;
 		model->small_sum_delay = 0ULL;
 		model->small_count = 0ULL;
 		model->large_sum_delay = 0ULL;
 		model->large_sum_bsize = 0ULL;
+		model->stddev = 0ULL;
+		lm_bump_gen(model);
 		spin_unlock_irqrestore(&model->lock, flags);
+
+		spin_lock_irqsave(&model->buckets_lock, flags);
+		model->variance = 0ULL;
+		spin_unlock_irqrestore(&model->buckets_lock, flags);
 	}
 
+	scoped_guard(spinlock_irqsave, &adios_model_groups_lock)
+		model_group_seed(ad);
+
+	return count;
+}
+
+// Show the name of the shared model group
+static ssize_t adios_model_group_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+
+	guard(spinlock_irqsave)(&adios_model_groups_lock);
+	return sprintf(page, "%s\n",
+		ad->model_group ? ad->model_group->name : "");
+}
+
+// Join a shared model group by name, or leave it with an empty name
+static ssize_t adios_model_group_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	char name[ADIOS_GROUP_NAME_LEN], *stripped;
+	int ret;
+
+	if (count >= sizeof(name))
+		return -EINVAL;
+	strscpy(name, page, min(count + 1, sizeof(name)));
+	stripped = strim(name);
+
+	if (!*stripped) {
+		scoped_guard(spinlock_irqsave, &adios_model_groups_lock)
+			kfree(model_group_leave(ad));
+		return count;
+	}
+
+	ret = model_group_join(ad, stripped);
+	if (ret)
+		return ret;
+
 	return count;
 }
 
@@ -1260,6 +3282,35 @@ SHRINK_THRESHOLD_ATTR_RW(at_kreqs,  lm_shrink_at_kreqs,  1, 100000)
 SHRINK_THRESHOLD_ATTR_RW(at_gbytes, lm_shrink_at_gbytes, 1,   1000)
 SHRINK_THRESHOLD_ATTR_RW(resist,    lm_shrink_resist,    1,      3)
 
+// Show whether cold models plan with a provisional estimate
+static ssize_t adios_lat_bootstrap_show(
+		struct elevator_queue *e, char *page) {
+	struct adios_data *ad = e->elevator_data;
+	return sprintf(page, "%d\n", READ_ONCE(ad->latency_model[0].bootstrap));
+}
+
+// Set whether cold models plan with a provisional estimate
+static ssize_t adios_lat_bootstrap_store(
+		struct elevator_queue *e, const char *page, size_t count) {
+	struct adios_data *ad = e->elevator_data;
+	bool val;
+	int ret;
+
+	ret = kstrtobool(page, &val);
+	if (ret)
+		return -EINVAL;
+
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
+		struct latency_model *model = &ad->latency_model[i];
+
+		guard(spinlock_irqsave)(&model->lock);
+		WRITE_ONCE(model->bootstrap, val);
+		lm_bump_gen(model);
+	}
+
+	return count;
+}
+
 // Define sysfs attributes
 #define AD_ATTR(name, show_func, store_func) \
 	__ATTR(name, 0644, show_func, store_func)
@@ -1273,20 +3324,69 @@ SHRINK_THRESHOLD_ATTR_RW(resist,    lm_shrink_resist,    1,      3)
 // Define sysfs attributes for ADIOS scheduler
 static struct elv_fs_entry adios_sched_attrs[] = {
 	AD_ATTR_RO(batch_actual_max),
+	AD_ATTR_RO(predicted_latency),
 	AD_ATTR_RW(bq_refill_below_ratio),
+	AD_ATTR_RW(fast_path_ratio),
 	AD_ATTR_RW(global_latency_window),
+	AD_ATTR_RO(parallelism),
+	AD_ATTR_RW(parallelism_scaling),
+
+	AD_ATTR_RW(latency_window_read),
+	AD_ATTR_RW(latency_window_write),
+	AD_ATTR_RW(latency_window_discard),
+	AD_ATTR_RW(latency_window_other),
+
+	AD_ATTR_RW(nowait_backlog_read),
+	AD_ATTR_RW(nowait_backlog_write),
+	AD_ATTR_RW(nowait_backlog_discard),
+	AD_ATTR_RW(nowait_backlog_other),
+
+	AD_ATTR_RW(throttle_backlog_read),
+	AD_ATTR_RW(throttle_backlog_write),
+	AD_ATTR_RW(throttle_backlog_discard),
+	AD_ATTR_RW(throttle_backlog_other),
 
 	AD_ATTR_RW(batch_limit_read),
 	AD_ATTR_RW(batch_limit_write),
 	AD_ATTR_RW(batch_limit_discard),
+	AD_ATTR_RW(batch_limit_other),
 
 	AD_ATTR_RO(lat_model_read),
 	AD_ATTR_RO(lat_model_write),
 	AD_ATTR_RO(lat_model_discard),
+	AD_ATTR_RO(lat_model_other),
 
 	AD_ATTR_RW(lat_target_read),
 	AD_ATTR_RW(lat_target_write),
 	AD_ATTR_RW(lat_target_discard),
+	AD_ATTR_RW(lat_target_other),
+
+	AD_ATTR_RW(part_target),
+	AD_ATTR_RO(part_stats),
+
+	AD_ATTR_RW(lat_target_swap),
+	AD_ATTR_RW(swap_priority),
+	AD_ATTR_RO(swap_stats),
+
+	AD_ATTR_RW(cdl_target_1),
+	AD_ATTR_RW(cdl_target_2),
+	AD_ATTR_RW(cdl_target_3),
+	AD_ATTR_RW(cdl_target_4),
+	AD_ATTR_RW(cdl_target_5),
+	AD_ATTR_RW(cdl_target_6),
+	AD_ATTR_RW(cdl_target_7),
+
+	AD_ATTR_RW(lat_sigma_k),
+	AD_ATTR_RW(lat_bootstrap),
+	AD_ATTR_RW(least_laxity),
+	AD_ATTR_RW(write_pacing),
+	AD_ATTR_RW(write_merge_delay),
+	AD_ATTR_RW(write_align_hold),
+	AD_ATTR_RO(write_align_unit),
+	AD_ATTR_RW(dispatch_locality),
+	AD_ATTR_RW(write_hint_group),
+	AD_ATTR_RW(write_hint_learn),
+	AD_ATTR_RO(write_hint_cost),
 
 	AD_ATTR_RW(shrink_at_kreqs),
 	AD_ATTR_RW(shrink_at_gbytes),
@@ -1296,6 +3396,7 @@ static struct elv_fs_entry adios_sched_attrs[] = {
 
 	AD_ATTR_WO(reset_bq_stats),
 	AD_ATTR_WO(reset_lat_model),
+	AD_ATTR_RW(model_group),
 	AD_ATTR(adios_version, adios_version_show, NULL),
 
 	__ATTR_NULL
@@ -1334,14 +3435,22 @@ MODULE_ALIAS("mq-adios-iosched");
 
 // Initialize the ADIOS scheduler module
 static int __init adios_init(void) {
+	int ret;
+
 	printk(KERN_INFO "%s %s by %s\n",
 		ADIOS_PROGNAME, ADIOS_VERSION, ADIOS_AUTHOR);
-	return elv_register(&mq_adios);
+	adios_debugfs_root = debugfs_create_dir("adios", NULL);
+	ret = elv_register(&mq_adios);
+	if (ret)
+		debugfs_remove(adios_debugfs_root);
+	return ret;
 }
 
 // Exit the ADIOS scheduler module
 static void __exit adios_exit(void) {
 	elv_unregister(&mq_adios);
+	cancel_delayed_work_sync(&adios_update_work);
+	debugfs_remove(adios_debugfs_root);
 }
 
 module_init(adios_init);
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * The Adaptive Deadline I/O Scheduler (ADIOS)
+ * Interface for stacked drivers
+ *
+ * Copyright (C) 2025 Masahito Suzuki
+ */
+#ifndef _ADIOS_H
+#define _ADIOS_H
+
+#include <linux/types.h>
+
+/*
+ * Latency predictor page
+ *
+ * Each queue scheduled by ADIOS exposes a read-only page at
+ * <debugfs>/adios/<disk>, which can be mmap()ed or read(). The predicted
+ * latency in nanoseconds of a request of a given operation type and size is
+ *   base + slope * DIV_ROUND_UP(bytes - 4096, 1024)   (bytes > 4096)
+ *   base                                              (bytes <= 4096)
+ * plus, if queueing delay is wanted, the backlog of that operation type
+ * divided by the device parallelism:
+ *   backlog * ADIOS_INFO_PAR_ONE / parallelism
+ *
+ * The page is only kept up to date while the file is open or mapped. The
+ * backlog fields are then refreshed on every insert and completion. The
+ * model fields and parallelism follow the coalesced model updates, so they
+ * may lag the device by up to about 100ms.
+ *
+ * The fields are consistent when seq is even and unchanged across the read:
+ *   do {
+ *           seq = READ_ONCE(info->seq);  (retry while odd)
+ *           rmb();  ...copy fields...  rmb();
+ *   } while (READ_ONCE(info->seq) != seq);
+ */
+#define ADIOS_INFO_VERSION        1
+#define ADIOS_INFO_OPTYPES        4  /* read, write, discard, other */
+#define ADIOS_INFO_SMALL_BYTES 4096
+#define ADIOS_INFO_PAR_ONE     1024
+
+struct adios_info_optype {
+	__u64 base;     /* ns */
+	__u64 slope;    /* ns per KiB above ADIOS_INFO_SMALL_BYTES */
+	__u64 stddev;   /* ns */
+	__u64 backlog;  /* predicted ns queued and in flight */
+};
+
+struct adios_info_page {
+	__u32 seq;
+	__u32 version;
+	__u32 parallelism;    /* effective device parallelism, ADIOS_INFO_PAR_ONE = 1 */
+	__u32 reserved;
+	__u64 total_backlog;  /* predicted ns in flight */
+	struct adios_info_optype optype[ADIOS_INFO_OPTYPES];
+};
+
+#ifdef __KERNEL__
+#include <linux/blk_types.h>
+
+struct request_queue;
+
+/*
+ * Predict the completion latency in nanoseconds of a hypothetical request
+ * of the given operation and size on @q, including the backlog ahead of it.
+ * Returns 0 if @q is not scheduled by ADIOS or nothing is known yet.
+ */
+u64 adios_predict_latency(struct request_queue *q, enum req_op op, u32 bytes);
+#endif /* __KERNEL__ */
+
+#endif /* _ADIOS_H */
@@ -0,0 +1,1256 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * adios-tune: offline parameter tuner for the Adaptive Deadline I/O Scheduler
+ *
+ * Replays a recorded block I/O trace through a userspace copy of the ADIOS
+ * scheduling core (latency model, deadline trees, batch filling and dispatch)
+ * on top of a simulated device, and searches the scheduler tunables for the
+ * highest throughput that keeps the 99th percentile read latency under a
+ * given bound. The result is printed as a shell script applying the settings
+ * through sysfs.
+ *
+ * By default the trace is replayed closed-loop, keeping a fixed number of
+ * its requests outstanding in order, so that the scheduler settings decide
+ * how fast it completes. An open-loop replay at the recorded arrival times
+ * only saturates the device if the trace was recorded under overload.
+ *
+ * Trace format, one request per line, as produced by
+ *   blkparse -a issue -f "%T.%9t %d %N\n" <trace>
+ * is "<seconds>.<nanoseconds> <RWBS> <bytes>".
+ *
+ * Copyright (C) 2025 Masahito Suzuki
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t  u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t  s32;
+typedef int64_t  s64;
+
+#define NSEC_PER_USEC 1000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_SEC  1000000000ULL
+#define U64_MAX       UINT64_MAX
+
+#define DIV_ROUND_UP_ULL(n, d) (((n) + (d) - 1) / (d))
+
+// Operation types, as in adios.c
+enum adios_op_type {
+	ADIOS_READ    = 0,
+	ADIOS_WRITE   = 1,
+	ADIOS_DISCARD = 2,
+	ADIOS_OTHER   = 3,
+	ADIOS_OPTYPES = 4,
+};
+
+static const char * const optype_names[ADIOS_OPTYPES] = {
+	[ADIOS_READ]    = "read",
+	[ADIOS_WRITE]   = "write",
+	[ADIOS_DISCARD] = "discard",
+	[ADIOS_OTHER]   = "other",
+};
+
+// Thresholds for latency model control, as in adios.c
+#define LM_BLOCK_SIZE_THRESHOLD 4096
+#define LM_SAMPLES_THRESHOLD    1024
+#define LM_INTERVAL_THRESHOLD   1500
+#define LM_OUTLIER_PERCENTILE     99
+#define LM_LAT_BUCKET_COUNT       64
+#define LM_BOOT_SAMPLES           64
+#define LM_BOOT_MIN_KIB            4
+
+// Delay between a completion and the coalesced model update
+#define LM_UPDATE_DELAY_MS       100
+
+#define ADIOS_BQ_PAGES 2
+
+static const int adios_prio_to_weight[40] = {
+ /* -20 */     88761,     71755,     56483,     46273,     36291,
+ /* -15 */     29154,     23254,     18705,     14949,     11916,
+ /* -10 */      9548,      7620,      6100,      4904,      3906,
+ /*  -5 */      3121,      2501,      1991,      1586,      1277,
+ /*   0 */      1024,       820,       655,       526,       423,
+ /*   5 */       335,       272,       215,       172,       137,
+ /*  10 */       110,        87,        70,        56,        45,
+ /*  15 */        36,        29,        23,        18,        15,
+};
+
+// Scheduler tunables searched by the tuner
+struct tunables {
+	u64 global_latency_window;
+	u64 latency_target[ADIOS_OPTYPES];
+	u32 batch_limit[ADIOS_OPTYPES];
+	u32 bq_refill_below_ratio;
+	u32 shrink_at_kreqs;
+	u32 shrink_at_gbytes;
+	u32 shrink_resist;
+	s32 read_priority;
+};
+
+// ADIOS defaults
+static const struct tunables default_tunables = {
+	.global_latency_window = 16000000ULL,
+	.latency_target = {
+		[ADIOS_READ]    =     1ULL * NSEC_PER_MSEC,
+		[ADIOS_WRITE]   =  2000ULL * NSEC_PER_MSEC,
+		[ADIOS_DISCARD] =  8000ULL * NSEC_PER_MSEC,
+		[ADIOS_OTHER]   =     0ULL * NSEC_PER_MSEC,
+	},
+	.batch_limit = {
+		[ADIOS_READ]    = 24,
+		[ADIOS_WRITE]   = 48,
+		[ADIOS_DISCARD] =  1,
+		[ADIOS_OTHER]   =  8,
+	},
+	.bq_refill_below_ratio = 15,
+	.shrink_at_kreqs  = 10000,
+	.shrink_at_gbytes =   100,
+	.shrink_resist    =     2,
+	.read_priority    =     7,
+};
+
+// Simulated device
+struct device_profile {
+	u64 base[ADIOS_OPTYPES];
+	u64 slope[ADIOS_OPTYPES];
+	u32 jitter_pct;
+	u32 parallelism;
+	u32 queue_depth;
+};
+
+static struct device_profile device = {
+	.base = {
+		[ADIOS_READ]    =   80000,
+		[ADIOS_WRITE]   =   30000,
+		[ADIOS_DISCARD] = 1000000,
+		[ADIOS_OTHER]   =   30000,
+	},
+	.slope = {
+		[ADIOS_READ]    =     250,
+		[ADIOS_WRITE]   =     400,
+		[ADIOS_DISCARD] =       0,
+		[ADIOS_OTHER]   =     400,
+	},
+	.jitter_pct  = 30,
+	.parallelism =  8,
+	.queue_depth = 32,
+};
+
+// One recorded request
+struct trace_entry {
+	u64 time;
+	u64 bytes;
+	u8  optype;
+};
+
+static struct trace_entry *trace;
+static u32 trace_len;
+
+/*
+ * Latency model
+ */
+
+struct latency_bucket_small {
+	u64 sum_latency;
+	u32 count;
+};
+
+struct latency_bucket_large {
+	u64 sum_latency;
+	u64 sum_block_size;
+	u32 count;
+};
+
+struct latency_model {
+	u64 base;
+	u64 slope;
+	u64 small_sum_delay;
+	u64 small_count;
+	u64 large_sum_delay;
+	u64 large_sum_bsize;
+	u64 last_update_ms;
+
+	struct latency_bucket_small small_bucket[LM_LAT_BUCKET_COUNT];
+	struct latency_bucket_large large_bucket[LM_LAT_BUCKET_COUNT];
+
+	u32 lm_shrink_at_kreqs;
+	u32 lm_shrink_at_gbytes;
+	u8  lm_shrink_resist;
+
+	u64 boot_sum_lat;
+	u64 boot_sum_kib;
+	u32 boot_count;
+	u64 boot_lat_per_kib;
+};
+
+static u32 lm_count_small_entries(struct latency_model *model) {
+	u32 total_count = 0;
+	for (u8 i = 0; i < LM_LAT_BUCKET_COUNT; i++)
+		total_count += model->small_bucket[i].count;
+	return total_count;
+}
+
+static void lm_update_small_buckets(struct latency_model *model,
+		u32 total_count, bool count_all) {
+	u64 sum_latency = 0;
+	u32 sum_count = 0;
+	u32 cumulative_count = 0, threshold_count;
+	u8  outlier_threshold_bucket = 0;
+	u8  outlier_percentile = count_all ? 100 : LM_OUTLIER_PERCENTILE;
+
+	threshold_count = (total_count * outlier_percentile) / 100;
+
+	for (u8 i = 0; i < LM_LAT_BUCKET_COUNT; i++) {
+		cumulative_count += model->small_bucket[i].count;
+		if (cumulative_count >= threshold_count) {
+			outlier_threshold_bucket = i;
+			break;
+		}
+	}
+
+	for (u8 i = 0; i <= outlier_threshold_bucket; i++) {
+		struct latency_bucket_small *bucket = &model->small_bucket[i];
+		if (i < outlier_threshold_bucket) {
+			sum_latency += bucket->sum_latency;
+			sum_count += bucket->count;
+		} else if (bucket->count > 0) {
+			u64 remaining_count =
+				threshold_count - (cumulative_count - bucket->count);
+			sum_latency +=
+				(bucket->sum_latency * remaining_count) / bucket->count;
+			sum_count += remaining_count;
+		}
+	}
+
+	if (model->small_count >= 1000ULL * model->lm_shrink_at_kreqs) {
+		u8 reduction = model->lm_shrink_resist;
+		if (model->small_count >> reduction) {
+			model->small_sum_delay -= model->small_sum_delay >> reduction;
+			model->small_count     -= model->small_count     >> reduction;
+		}
+	}
+
+	model->small_sum_delay += sum_latency;
+	model->small_count += sum_count;
+
+	memset(model->small_bucket, 0, sizeof(model->small_bucket));
+}
+
+static u32 lm_count_large_entries(struct latency_model *model) {
+	u32 total_count = 0;
+	for (u8 i = 0; i < LM_LAT_BUCKET_COUNT; i++)
+		total_count += model->large_bucket[i].count;
+	return total_count;
+}
+
+static void lm_update_large_buckets(struct latency_model *model,
+		u32 total_count, bool count_all) {
+	s64 sum_latency = 0;
+	u64 sum_block_size = 0, intercept;
+	u32 cumulative_count = 0, threshold_count;
+	u8  outlier_threshold_bucket = 0;
+	u8  outlier_percentile = count_all ? 100 : LM_OUTLIER_PERCENTILE;
+
+	threshold_count = (total_count * outlier_percentile) / 100;
+
+	for (u8 i = 0; i < LM_LAT_BUCKET_COUNT; i++) {
+		cumulative_count += model->large_bucket[i].count;
+		if (cumulative_count >= threshold_count) {
+			outlier_threshold_bucket = i;
+			break;
+		}
+	}
+
+	for (u8 i = 0; i <= outlier_threshold_bucket; i++) {
+		struct latency_bucket_large *bucket = &model->large_bucket[i];
+		if (i < outlier_threshold_bucket) {
+			sum_latency += bucket->sum_latency;
+			sum_block_size += bucket->sum_block_size;
+		} else if (bucket->count > 0) {
+			u64 remaining_count =
+				threshold_count - (cumulative_count - bucket->count);
+			sum_latency +=
+				(bucket->sum_latency * remaining_count) / bucket->count;
+			sum_block_size +=
+				(bucket->sum_block_size * remaining_count) / bucket->count;
+		}
+	}
+
+	if (model->large_sum_bsize >= 0x40000000ULL * model->lm_shrink_at_gbytes) {
+		u8 reduction = model->lm_shrink_resist;
+		if (model->large_sum_bsize >> reduction) {
+			model->large_sum_delay -= model->large_sum_delay >> reduction;
+			model->large_sum_bsize -= model->large_sum_bsize >> reduction;
+		}
+	}
+
+	intercept = model->base * threshold_count;
+	if (sum_latency > (s64)intercept)
+		sum_latency -= intercept;
+
+	model->large_sum_delay += sum_latency;
+	model->large_sum_bsize += sum_block_size;
+
+	memset(model->large_bucket, 0, sizeof(model->large_bucket));
+}
+
+static void latency_model_update(struct latency_model *model, u64 now_ms) {
+	u32 small_count, large_count;
+	bool time_elapsed;
+	bool small_processed = false, large_processed = false;
+
+	time_elapsed = !model->base ||
+		model->last_update_ms + LM_INTERVAL_THRESHOLD <= now_ms;
+
+	small_count = lm_count_small_entries(model);
+	large_count = lm_count_large_entries(model);
+
+	if (small_count && (time_elapsed ||
+			LM_SAMPLES_THRESHOLD <= small_count || !model->base)) {
+		lm_update_small_buckets(model, small_count, !model->base);
+		small_processed = true;
+	}
+	if (large_count && (time_elapsed ||
+			LM_SAMPLES_THRESHOLD <= large_count || !model->slope)) {
+		lm_update_large_buckets(model, large_count, !model->slope);
+		large_processed = true;
+	}
+
+	if (small_processed && model->small_count)
+		model->base = model->small_sum_delay / model->small_count;
+
+	if (large_processed && model->large_sum_bsize)
+		model->slope = model->large_sum_delay /
+			DIV_ROUND_UP_ULL(model->large_sum_bsize, 1024);
+
+	if (time_elapsed)
+		model->last_update_ms = now_ms;
+}
+
+static u8 lm_input_bucket_index(u64 measured, u64 predicted) {
+	u64 bucket_index;
+
+	if (measured < predicted * 2)
+		bucket_index = (measured * 20) / predicted;
+	else if (measured < predicted * 5)
+		bucket_index = (measured * 10) / predicted + 20;
+	else
+		bucket_index = (measured * 3) / predicted + 40;
+
+	if (bucket_index >= LM_LAT_BUCKET_COUNT)
+		bucket_index = LM_LAT_BUCKET_COUNT - 1;
+	return bucket_index;
+}
+
+static u64 lm_boot_kib(u64 block_size) {
+	u64 kib = DIV_ROUND_UP_ULL(block_size, 1024);
+	return kib > LM_BOOT_MIN_KIB ? kib : LM_BOOT_MIN_KIB;
+}
+
+static void lm_input_bootstrap(struct latency_model *model,
+		u64 block_size, u64 latency) {
+	if (model->boot_count >= LM_BOOT_SAMPLES) {
+		model->boot_sum_lat >>= 1;
+		model->boot_sum_kib >>= 1;
+		model->boot_count >>= 1;
+	}
+	model->boot_sum_lat += latency;
+	model->boot_sum_kib += lm_boot_kib(block_size);
+	model->boot_count++;
+	model->boot_lat_per_kib = model->boot_sum_lat * 2 / model->boot_sum_kib;
+}
+
+static bool lm_ready(struct latency_model *model) {
+	return model->base || model->boot_lat_per_kib;
+}
+
+static void latency_model_input(struct latency_model *model,
+		u64 block_size, u64 latency, u64 pred_lat, u64 now_ms) {
+	u8 bucket_index;
+
+	if (!model->base)
+		lm_input_bootstrap(model, block_size, latency);
+
+	if (block_size <= LM_BLOCK_SIZE_THRESHOLD) {
+		bucket_index = lm_input_bucket_index(latency, model->base ?: 1);
+		model->small_bucket[bucket_index].count++;
+		model->small_bucket[bucket_index].sum_latency += latency;
+
+		if (!model->base)
+			latency_model_update(model, now_ms);
+	} else {
+		if (!model->base || !pred_lat)
+			return;
+
+		bucket_index = lm_input_bucket_index(latency, pred_lat);
+		model->large_bucket[bucket_index].count++;
+		model->large_bucket[bucket_index].sum_latency += latency;
+		model->large_bucket[bucket_index].sum_block_size += block_size;
+	}
+}
+
+static u64 latency_model_predict(struct latency_model *model, u64 block_size) {
+	u64 result = model->base;
+
+	if (!model->base)
+		return model->boot_lat_per_kib * lm_boot_kib(block_size);
+	if (block_size > LM_BLOCK_SIZE_THRESHOLD)
+		result += model->slope *
+			DIV_ROUND_UP_ULL(block_size - LM_BLOCK_SIZE_THRESHOLD, 1024);
+	return result;
+}
+
+/*
+ * Minimal binary min-heap of request indices
+ */
+
+struct heap_entry {
+	u64 key;
+	u64 tie;
+	u32 idx;
+};
+
+struct heap {
+	struct heap_entry *e;
+	u32 n;
+};
+
+static bool heap_less(const struct heap_entry *a, const struct heap_entry *b) {
+	return a->key < b->key || (a->key == b->key && a->tie < b->tie);
+}
+
+static void heap_push(struct heap *h, u64 key, u64 tie, u32 idx) {
+	u32 i = h->n++;
+
+	h->e[i] = (struct heap_entry){ key, tie, idx };
+	while (i) {
+		u32 parent = (i - 1) / 2;
+		struct heap_entry tmp;
+
+		if (!heap_less(&h->e[i], &h->e[parent]))
+			break;
+		tmp = h->e[i];
+		h->e[i] = h->e[parent];
+		h->e[parent] = tmp;
+		i = parent;
+	}
+}
+
+static void heap_pop(struct heap *h) {
+	u32 i = 0;
+
+	h->e[0] = h->e[--h->n];
+	while (true) {
+		u32 l = 2 * i + 1, r = l + 1, m = i;
+		struct heap_entry tmp;
+
+		if (l < h->n && heap_less(&h->e[l], &h->e[m]))
+			m = l;
+		if (r < h->n && heap_less(&h->e[r], &h->e[m]))
+			m = r;
+		if (m == i)
+			break;
+		tmp = h->e[i];
+		h->e[i] = h->e[m];
+		h->e[m] = tmp;
+		i = m;
+	}
+}
+
+/*
+ * Scheduling core and simulated device
+ */
+
+struct sim_rq {
+	u64 arrival;
+	u64 bytes;
+	u64 deadline;
+	u64 pred_lat;
+	u64 dispatch;
+	s32 next;
+	u8  optype;
+};
+
+struct sim {
+	const struct tunables *t;
+	struct sim_rq *rqs;
+	u64 seq;
+	u64 rng;
+
+	struct heap dl_tree[2];
+	s64 dl_bias;
+	s32 dl_prio[2];
+
+	struct latency_model latency_model[ADIOS_OPTYPES];
+	bool update_pending;
+	u64 update_at;
+
+	u64 total_pred_lat;
+	u8  bq_page;
+	bool more_bq_ready;
+	s32 bq_head[ADIOS_BQ_PAGES][ADIOS_OPTYPES];
+	s32 bq_tail[ADIOS_BQ_PAGES][ADIOS_OPTYPES];
+	u32 batch_count[ADIOS_BQ_PAGES][ADIOS_OPTYPES];
+
+	struct heap done;
+	u64 *server_free;
+	u32 inflight;
+};
+
+struct sim_result {
+	double throughput;
+	u64 p99_read;
+	u64 mean_read;
+};
+
+static u64 rng_next(struct sim *s) {
+	s->rng ^= s->rng << 13;
+	s->rng ^= s->rng >> 7;
+	s->rng ^= s->rng << 17;
+	return s->rng;
+}
+
+// Service time of a request on the simulated device
+static u64 device_service_time(struct sim *s, struct sim_rq *rq) {
+	u64 svc = device.base[rq->optype] +
+		device.slope[rq->optype] * DIV_ROUND_UP_ULL(rq->bytes, 1024);
+	double u, factor;
+
+	if (!device.jitter_pct)
+		return svc;
+
+	// Exponentially distributed jitter around the nominal service time
+	u = (double)((rng_next(s) >> 11) + 1) / (double)(1ULL << 53);
+	factor = 1.0 + device.jitter_pct / 100.0 * (-log(u) - 1.0);
+	if (factor < 0.1)
+		factor = 0.1;
+	return (u64)(svc * factor);
+}
+
+static struct sim_rq *dl_first(struct sim *s, bool idx) {
+	return &s->rqs[s->dl_tree[idx].e[0].idx];
+}
+
+static u8 dl_queued(struct sim *s) {
+	return (s->dl_tree[0].n ? 0x1 : 0) | (s->dl_tree[1].n ? 0x2 : 0);
+}
+
+static void insert_request(struct sim *s, u32 idx) {
+	struct sim_rq *rq = &s->rqs[idx];
+	bool dl_idx = rq->optype != ADIOS_READ;
+
+	rq->pred_lat =
+		latency_model_predict(&s->latency_model[rq->optype], rq->bytes);
+	rq->deadline =
+		rq->arrival + s->t->latency_target[rq->optype] + rq->pred_lat;
+	heap_push(&s->dl_tree[dl_idx], rq->deadline, s->seq++, idx);
+}
+
+static s32 next_request(struct sim *s) {
+	u8 queued = dl_queued(s);
+	struct sim_rq *rd;
+	bool dl_idx, bias_idx, reduce_bias;
+	s32 idx;
+
+	if (!queued)
+		return -1;
+
+	dl_idx = queued >> 1;
+	idx = s->dl_tree[dl_idx].e[0].idx;
+	rd = dl_first(s, dl_idx);
+
+	bias_idx = s->dl_bias < 0;
+	reduce_bias = (bias_idx == dl_idx);
+
+	if (queued == 0x3) {
+		struct sim_rq *trd[2] = { dl_first(s, 0), rd };
+
+		idx = s->dl_tree[bias_idx].e[0].idx;
+		rd = trd[bias_idx];
+		reduce_bias = trd[bias_idx]->deadline > trd[!bias_idx]->deadline;
+	}
+
+	if (reduce_bias) {
+		s64 sign = ((int)bias_idx << 1) - 1;
+		if (!rd->pred_lat)
+			s->dl_bias = sign;
+		else
+			s->dl_bias += sign * (s64)((rd->pred_lat *
+				adios_prio_to_weight[s->dl_prio[bias_idx] + 20]) >> 10);
+	}
+
+	return idx;
+}
+
+static void bq_push(struct sim *s, u8 page, u8 optype, u32 idx) {
+	s->rqs[idx].next = -1;
+	if (s->bq_tail[page][optype] < 0)
+		s->bq_head[page][optype] = idx;
+	else
+		s->rqs[s->bq_tail[page][optype]].next = idx;
+	s->bq_tail[page][optype] = idx;
+}
+
+static s32 bq_pop(struct sim *s, u8 page, u8 optype) {
+	s32 idx = s->bq_head[page][optype];
+
+	if (idx < 0)
+		return -1;
+	s->bq_head[page][optype] = s->rqs[idx].next;
+	if (s->bq_head[page][optype] < 0)
+		s->bq_tail[page][optype] = -1;
+	return idx;
+}
+
+static void fill_batch_queues(struct sim *s, u64 current_lat) {
+	u8 page = (s->bq_page + 1) % ADIOS_BQ_PAGES;
+	u32 count = 0;
+
+	memset(s->batch_count[page], 0, sizeof(s->batch_count[page]));
+
+	while (true) {
+		s32 idx = next_request(s);
+		struct sim_rq *rq;
+		u8 optype;
+
+		if (idx < 0)
+			break;
+		rq = &s->rqs[idx];
+		optype = rq->optype;
+		current_lat += rq->pred_lat;
+
+		if (count && (!lm_ready(&s->latency_model[optype]) ||
+				s->batch_count[page][optype] >= s->t->batch_limit[optype] ||
+				current_lat > s->t->global_latency_window))
+			break;
+
+		heap_pop(&s->dl_tree[optype != ADIOS_READ]);
+		bq_push(s, page, optype, idx);
+		s->batch_count[page][optype]++;
+		s->total_pred_lat += rq->pred_lat;
+		count++;
+	}
+
+	if (count)
+		s->more_bq_ready = true;
+}
+
+static s32 dispatch_request(struct sim *s) {
+	u64 tpl = s->total_pred_lat;
+	s32 idx;
+
+	if (!s->more_bq_ready && (!tpl || tpl <
+			s->t->global_latency_window * s->t->bq_refill_below_ratio / 100))
+		fill_batch_queues(s, tpl);
+
+again:
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
+		idx = bq_pop(s, s->bq_page, i);
+		if (idx >= 0)
+			return idx;
+	}
+
+	if (s->more_bq_ready) {
+		s->more_bq_ready = false;
+		s->bq_page = (s->bq_page + 1) % ADIOS_BQ_PAGES;
+		goto again;
+	}
+
+	return -1;
+}
+
+// Hand a request to the earliest available device server
+static void device_submit(struct sim *s, u32 idx, u64 now) {
+	struct sim_rq *rq = &s->rqs[idx];
+	u32 best = 0;
+	u64 start;
+
+	for (u32 i = 1; i < device.parallelism; i++)
+		if (s->server_free[i] < s->server_free[best])
+			best = i;
+
+	start = s->server_free[best] > now ? s->server_free[best] : now;
+	s->server_free[best] = start + device_service_time(s, rq);
+	rq->dispatch = now;
+	s->inflight++;
+	heap_push(&s->done, s->server_free[best], s->seq++, idx);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+	return x < y ? -1 : x > y;
+}
+
+// Replay the trace with a given set of tunables. With a non-zero depth the
+// replay is closed-loop: the next request is issued as soon as fewer than
+// depth are outstanding, so throughput reflects the scheduler rather than
+// the recorded arrival rate. Otherwise requests arrive at their recorded
+// times, divided by time_scale.
+static int simulate(const struct tunables *t, u32 depth, double time_scale,
+		u64 seed, struct sim_result *res) {
+	struct sim s = { .t = t, .rng = seed ?: 1 };
+	u64 *read_lat = NULL, first = U64_MAX, last = 0, total_bytes = 0;
+	u64 sum_read = 0, clock = 0;
+	u32 nr_reads = 0, next_arrival = 0, outstanding = 0;
+	int ret = -ENOMEM;
+
+	s.rqs = calloc(trace_len, sizeof(*s.rqs));
+	s.dl_tree[0].e = calloc(trace_len, sizeof(struct heap_entry));
+	s.dl_tree[1].e = calloc(trace_len, sizeof(struct heap_entry));
+	s.done.e = calloc(trace_len, sizeof(struct heap_entry));
+	s.server_free = calloc(device.parallelism, sizeof(u64));
+	read_lat = calloc(trace_len, sizeof(u64));
+	if (!s.rqs || !s.dl_tree[0].e || !s.dl_tree[1].e || !s.done.e ||
+			!s.server_free || !read_lat)
+		goto out;
+
+	s.dl_prio[0] = t->read_priority;
+	s.dl_prio[1] = 0;
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
+		s.latency_model[i].lm_shrink_at_kreqs  = t->shrink_at_kreqs;
+		s.latency_model[i].lm_shrink_at_gbytes = t->shrink_at_gbytes;
+		s.latency_model[i].lm_shrink_resist    = t->shrink_resist;
+	}
+	for (u8 p = 0; p < ADIOS_BQ_PAGES; p++) {
+		for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
+			s.bq_head[p][i] = -1;
+			s.bq_tail[p][i] = -1;
+		}
+	}
+
+	for (u32 i = 0; i < trace_len; i++) {
+		s.rqs[i].arrival = (u64)((trace[i].time - trace[0].time) / time_scale);
+		s.rqs[i].bytes = trace[i].bytes;
+		s.rqs[i].optype = trace[i].optype;
+	}
+
+	while (true) {
+		u64 t_arrival = U64_MAX;
+		u64 t_done = s.done.n ? s.done.e[0].key : U64_MAX;
+		u64 t_update = s.update_pending ? s.update_at : U64_MAX;
+		u64 now;
+
+		if (next_arrival < trace_len) {
+			if (!depth)
+				t_arrival = s.rqs[next_arrival].arrival;
+			else if (outstanding < depth)
+				t_arrival = clock;
+		}
+
+		now = t_arrival;
+		if (t_done < now)
+			now = t_done;
+		if (t_update < now)
+			now = t_update;
+		if (now == U64_MAX)
+			break;
+		clock = now;
+
+		if (now == t_done) {
+			u32 idx = s.done.e[0].idx;
+			struct sim_rq *rq = &s.rqs[idx];
+
+			heap_pop(&s.done);
+			s.inflight--;
+			outstanding--;
+			s.total_pred_lat -= rq->pred_lat;
+
+			if (rq->bytes)
+				latency_model_input(&s.latency_model[rq->optype],
+					rq->bytes, now - rq->dispatch, rq->pred_lat,
+					now / NSEC_PER_MSEC);
+			if (!s.update_pending) {
+				s.update_pending = true;
+				s.update_at = now + LM_UPDATE_DELAY_MS * NSEC_PER_MSEC;
+			}
+
+			if (rq->optype == ADIOS_READ) {
+				read_lat[nr_reads++] = now - rq->arrival;
+				sum_read += now - rq->arrival;
+			}
+			total_bytes += rq->bytes;
+			if (rq->arrival < first)
+				first = rq->arrival;
+			last = now;
+		} else if (now == t_arrival) {
+			if (depth)
+				s.rqs[next_arrival].arrival = now;
+			outstanding++;
+			insert_request(&s, next_arrival++);
+		} else {
+			s.update_pending = false;
+			for (u8 i = 0; i < ADIOS_OPTYPES; i++)
+				latency_model_update(&s.latency_model[i],
+					now / NSEC_PER_MSEC);
+		}
+
+		while (s.inflight < device.queue_depth) {
+			s32 idx = dispatch_request(&s);
+			if (idx < 0)
+				break;
+			device_submit(&s, idx, now);
+		}
+	}
+
+	qsort(read_lat, nr_reads, sizeof(u64), cmp_u64);
+	res->p99_read = nr_reads ? read_lat[(u64)(nr_reads - 1) * 99 / 100] : 0;
+	res->mean_read = nr_reads ? sum_read / nr_reads : 0;
+	res->throughput = last > first ?
+		(double)total_bytes / (1 << 20) / ((double)(last - first) / NSEC_PER_SEC) :
+		0.0;
+	ret = 0;
+out:
+	free(read_lat);
+	free(s.server_free);
+	free(s.done.e);
+	free(s.dl_tree[1].e);
+	free(s.dl_tree[0].e);
+	free(s.rqs);
+	return ret;
+}
+
+/*
+ * Parameter search
+ */
+
+enum param_id {
+	P_WINDOW,
+	P_BATCH_READ,
+	P_BATCH_WRITE,
+	P_BATCH_DISCARD,
+	P_BATCH_OTHER,
+	P_REFILL_RATIO,
+	P_TARGET_READ,
+	P_TARGET_WRITE,
+	P_TARGET_DISCARD,
+	P_TARGET_OTHER,
+	P_SHRINK_KREQS,
+	P_SHRINK_GBYTES,
+	P_SHRINK_RESIST,
+	P_READ_PRIORITY,
+	P_COUNT,
+};
+
+struct param {
+	const char *name;
+	u8 nr_values;
+	s64 values[8];
+};
+
+static const struct param params[P_COUNT] = {
+	[P_WINDOW]         = { "global_latency_window", 7,
+		{ 2000000, 4000000, 8000000, 16000000, 32000000, 64000000, 128000000 } },
+	[P_BATCH_READ]     = { "batch_limit_read", 7,
+		{ 4, 8, 16, 24, 32, 48, 64 } },
+	[P_BATCH_WRITE]    = { "batch_limit_write", 7,
+		{ 8, 16, 32, 48, 64, 96, 128 } },
+	[P_BATCH_DISCARD]  = { "batch_limit_discard", 4,
+		{ 1, 2, 4, 8 } },
+	[P_BATCH_OTHER]    = { "batch_limit_other", 6,
+		{ 1, 2, 4, 8, 16, 32 } },
+	[P_REFILL_RATIO]   = { "bq_refill_below_ratio", 6,
+		{ 5, 10, 15, 25, 40, 60 } },
+	[P_TARGET_READ]    = { "lat_target_read", 6,
+		{ 250000, 500000, 1000000, 2000000, 5000000, 10000000 } },
+	[P_TARGET_WRITE]   = { "lat_target_write", 5,
+		{ 100000000, 500000000, 2000000000, 5000000000, 10000000000 } },
+	[P_TARGET_DISCARD] = { "lat_target_discard", 4,
+		{ 1000000000, 4000000000, 8000000000, 16000000000 } },
+	[P_TARGET_OTHER]   = { "lat_target_other", 6,
+		{ 0, 1000000, 10000000, 100000000, 1000000000, 8000000000 } },
+	[P_SHRINK_KREQS]   = { "shrink_at_kreqs", 3,
+		{ 1000, 10000, 100000 } },
+	[P_SHRINK_GBYTES]  = { "shrink_at_gbytes", 3,
+		{ 10, 100, 1000 } },
+	[P_SHRINK_RESIST]  = { "shrink_resist", 3,
+		{ 1, 2, 3 } },
+	[P_READ_PRIORITY]  = { "read_priority", 7,
+		{ -10, -5, 0, 3, 7, 12, 19 } },
+};
+
+static s64 param_get(const struct tunables *t, enum param_id id) {
+	switch (id) {
+	case P_WINDOW:         return t->global_latency_window;
+	case P_BATCH_READ:     return t->batch_limit[ADIOS_READ];
+	case P_BATCH_WRITE:    return t->batch_limit[ADIOS_WRITE];
+	case P_BATCH_DISCARD:  return t->batch_limit[ADIOS_DISCARD];
+	case P_BATCH_OTHER:    return t->batch_limit[ADIOS_OTHER];
+	case P_REFILL_RATIO:   return t->bq_refill_below_ratio;
+	case P_TARGET_READ:    return t->latency_target[ADIOS_READ];
+	case P_TARGET_WRITE:   return t->latency_target[ADIOS_WRITE];
+	case P_TARGET_DISCARD: return t->latency_target[ADIOS_DISCARD];
+	case P_TARGET_OTHER:   return t->latency_target[ADIOS_OTHER];
+	case P_SHRINK_KREQS:   return t->shrink_at_kreqs;
+	case P_SHRINK_GBYTES:  return t->shrink_at_gbytes;
+	case P_SHRINK_RESIST:  return t->shrink_resist;
+	case P_READ_PRIORITY:  return t->read_priority;
+	default:               return 0;
+	}
+}
+
+static void param_set(struct tunables *t, enum param_id id, s64 val) {
+	switch (id) {
+	case P_WINDOW:         t->global_latency_window = val; break;
+	case P_BATCH_READ:     t->batch_limit[ADIOS_READ] = val; break;
+	case P_BATCH_WRITE:    t->batch_limit[ADIOS_WRITE] = val; break;
+	case P_BATCH_DISCARD:  t->batch_limit[ADIOS_DISCARD] = val; break;
+	case P_BATCH_OTHER:    t->batch_limit[ADIOS_OTHER] = val; break;
+	case P_REFILL_RATIO:   t->bq_refill_below_ratio = val; break;
+	case P_TARGET_READ:    t->latency_target[ADIOS_READ] = val; break;
+	case P_TARGET_WRITE:   t->latency_target[ADIOS_WRITE] = val; break;
+	case P_TARGET_DISCARD: t->latency_target[ADIOS_DISCARD] = val; break;
+	case P_TARGET_OTHER:   t->latency_target[ADIOS_OTHER] = val; break;
+	case P_SHRINK_KREQS:   t->shrink_at_kreqs = val; break;
+	case P_SHRINK_GBYTES:  t->shrink_at_gbytes = val; break;
+	case P_SHRINK_RESIST:  t->shrink_resist = val; break;
+	case P_READ_PRIORITY:  t->read_priority = val; break;
+	default:               break;
+	}
+}
+
+// Whether result a is preferable to result b under the p99 read bound
+static bool result_better(const struct sim_result *a,
+		const struct sim_result *b, u64 p99_bound) {
+	bool a_ok = a->p99_read <= p99_bound, b_ok = b->p99_read <= p99_bound;
+
+	if (a_ok != b_ok)
+		return a_ok;
+	if (!a_ok)
+		return a->p99_read < b->p99_read;
+	if (a->throughput != b->throughput)
+		return a->throughput > b->throughput;
+	return a->p99_read < b->p99_read;
+}
+
+/*
+ * Input parsing
+ */
+
+static int cmp_trace_entry(const void *a, const void *b) {
+	const struct trace_entry *x = a, *y = b;
+	return x->time < y->time ? -1 : x->time > y->time;
+}
+
+static int parse_optype(const char *rwbs, u8 *optype) {
+	if (strchr(rwbs, 'D'))
+		*optype = ADIOS_DISCARD;
+	else if (strchr(rwbs, 'W'))
+		*optype = ADIOS_WRITE;
+	else if (strchr(rwbs, 'R'))
+		*optype = ADIOS_READ;
+	else
+		return -EINVAL;
+	return 0;
+}
+
+static int load_trace(const char *path) {
+	FILE *f = fopen(path, "r");
+	char line[256];
+	u32 cap = 0;
+
+	if (!f)
+		return -errno;
+
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long sec = 0, nsec = 0, bytes;
+		char rwbs[16], frac[16] = "";
+		struct trace_entry *e;
+		u8 optype;
+
+		if (sscanf(line, "%llu.%15[0-9] %15s %llu",
+				&sec, frac, rwbs, &bytes) != 4)
+			continue;
+		if (parse_optype(rwbs, &optype))
+			continue;
+
+		// Scale the fractional part to nanoseconds
+		for (u32 i = 0; i < 9; i++)
+			nsec = nsec * 10 + (frac[i] ? frac[i] - '0' : 0);
+		if (strlen(frac) > 9)
+			continue;
+
+		if (trace_len == cap) {
+			struct trace_entry *n;
+
+			cap = cap ? cap * 2 : 4096;
+			n = realloc(trace, cap * sizeof(*trace));
+			if (!n) {
+				fclose(f);
+				return -ENOMEM;
+			}
+			trace = n;
+		}
+		e = &trace[trace_len++];
+		e->time = sec * NSEC_PER_SEC + nsec;
+		e->bytes = bytes;
+		e->optype = optype;
+	}
+	fclose(f);
+
+	// The replay expects requests in issue order
+	qsort(trace, trace_len, sizeof(*trace), cmp_trace_entry);
+
+	return trace_len ? 0 : -ENODATA;
+}
+
+static int set_device_key(const char *key, unsigned long long val) {
+	for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "%s_base_ns", optype_names[i]);
+		if (!strcmp(key, name)) {
+			device.base[i] = val;
+			return 0;
+		}
+		snprintf(name, sizeof(name), "%s_slope_ns_per_kib", optype_names[i]);
+		if (!strcmp(key, name)) {
+			device.slope[i] = val;
+			return 0;
+		}
+	}
+	if (!strcmp(key, "jitter_pct"))
+		device.jitter_pct = val;
+	else if (!strcmp(key, "parallelism") && val)
+		device.parallelism = val;
+	else if (!strcmp(key, "queue_depth") && val)
+		device.queue_depth = val;
+	else
+		return -EINVAL;
+	return 0;
+}
+
+// Device profile: "key = value" lines, '#' starts a comment
+static int load_device_profile(const char *path) {
+	FILE *f = fopen(path, "r");
+	char line[256];
+	u32 lineno = 0;
+
+	if (!f)
+		return -errno;
+
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long val;
+		char key[64];
+
+		lineno++;
+		if (line[strspn(line, " \t")] == '#' ||
+				line[strspn(line, " \t\n")] == '\0')
+			continue;
+		if (sscanf(line, " %63[a-z_] = %llu", key, &val) != 2 ||
+				set_device_key(key, val)) {
+			fprintf(stderr, "%s:%u: invalid line\n", path, lineno);
+			fclose(f);
+			return -EINVAL;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+// null_blk configuration: "completion_nsec=N,hw_queue_depth=N,..."
+static int load_nullb_config(char *spec) {
+	for (char *tok = strtok(spec, ","); tok; tok = strtok(NULL, ",")) {
+		unsigned long long val;
+		char key[64];
+
+		if (sscanf(tok, "%63[a-z_]=%llu", key, &val) != 2)
+			return -EINVAL;
+
+		if (!strcmp(key, "completion_nsec")) {
+			for (u8 i = 0; i < ADIOS_OPTYPES; i++) {
+				device.base[i] = val;
+				device.slope[i] = 0;
+			}
+		} else if (!strcmp(key, "hw_queue_depth") && val) {
+			// null_blk completes every queued command on its own timer
+			device.queue_depth = val;
+			device.parallelism = val;
+		} else if (strcmp(key, "submit_queues") && strcmp(key, "irqmode")) {
+			return -EINVAL;
+		}
+	}
+	device.jitter_pct = 0;
+	return 0;
+}
+
+static void print_script(FILE *out, const struct tunables *t,
+		const struct sim_result *res, u64 p99_bound) {
+	fprintf(out, "#!/bin/sh\n");
+	fprintf(out, "# Generated by adios-tune\n");
+	fprintf(out, "# Simulated throughput %.1f MiB/s, read p99 %llu us "
+		"(bound %llu us), read mean %llu us\n", res->throughput,
+		(unsigned long long)(res->p99_read / NSEC_PER_USEC),
+		(unsigned long long)(p99_bound / NSEC_PER_USEC),
+		(unsigned long long)(res->mean_read / NSEC_PER_USEC));
+	fprintf(out, "dev=${1:?usage: $0 <block device, e.g. nvme0n1>}\n");
+	fprintf(out, "q=/sys/block/$dev/queue/iosched\n");
+	fprintf(out, "set -e\n");
+	// Writing lat_target_* makes the scheduler relearn that latency model.
+	// Write changed targets first and leave the default ones alone.
+	for (u32 id = P_TARGET_READ; id <= P_TARGET_OTHER; id++) {
+		if (param_get(t, id) == param_get(&default_tunables, id))
+			continue;
+		fprintf(out, "echo %lld > \"$q/%s\"\n",
+			(long long)param_get(t, id), params[id].name);
+	}
+	for (u32 id = 0; id < P_COUNT; id++) {
+		if (id >= P_TARGET_READ && id <= P_TARGET_OTHER)
+			continue;
+		fprintf(out, "echo %lld > \"$q/%s\"\n",
+			(long long)param_get(t, id), params[id].name);
+	}
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr,
+		"usage: %s [options] <trace>\n"
+		"  -p, --p99-read-us N   99th percentile read latency bound in us (default 1000)\n"
+		"  -d, --device FILE     simulated device profile (key = value lines)\n"
+		"  -n, --nullb SPEC      null_blk configuration, e.g. completion_nsec=10000,hw_queue_depth=64\n"
+		"  -q, --depth N         requests kept outstanding in the closed-loop replay\n"
+		"                        (default 64; 0 replays at the recorded arrival times)\n"
+		"  -s, --time-scale F    with -q 0, replay the trace F times faster (default 1.0)\n"
+		"  -r, --rounds N        coordinate descent rounds (default 3)\n"
+		"  -S, --seed N          device jitter seed (default 1)\n"
+		"  -o, --output FILE     write the sysfs script to FILE (default stdout)\n"
+		"\n"
+		"Device profile keys: {read,write,discard,other}_base_ns,\n"
+		"{read,write,discard,other}_slope_ns_per_kib, jitter_pct, parallelism,\n"
+		"queue_depth.\n", prog);
+}
+
+int main(int argc, char **argv) {
+	static const struct option long_opts[] = {
+		{ "p99-read-us", required_argument, NULL, 'p' },
+		{ "device",      required_argument, NULL, 'd' },
+		{ "nullb",       required_argument, NULL, 'n' },
+		{ "depth",       required_argument, NULL, 'q' },
+		{ "time-scale",  required_argument, NULL, 's' },
+		{ "rounds",      required_argument, NULL, 'r' },
+		{ "seed",        required_argument, NULL, 'S' },
+		{ "output",      required_argument, NULL, 'o' },
+		{ "help",        no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	struct tunables best = default_tunables;
+	struct sim_result best_res;
+	u64 p99_bound = 1000 * NSEC_PER_USEC, seed = 1;
+	double time_scale = 1.0;
+	u32 depth = 64, rounds = 3;
+	FILE *out = stdout;
+	int opt, ret;
+
+	while ((opt = getopt_long(argc, argv, "p:d:n:q:s:r:S:o:h",
+			long_opts, NULL)) != -1) {
+		switch (opt) {
+		case 'p':
+			p99_bound = strtoull(optarg, NULL, 10) * NSEC_PER_USEC;
+			break;
+		case 'd':
+			ret = load_device_profile(optarg);
+			if (ret) {
+				fprintf(stderr, "%s: %s\n", optarg, strerror(-ret));
+				return 1;
+			}
+			break;
+		case 'n':
+			if (load_nullb_config(optarg)) {
+				fprintf(stderr, "invalid null_blk configuration\n");
+				return 1;
+			}
+			break;
+		case 'q':
+			depth = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			time_scale = strtod(optarg, NULL);
+			if (time_scale <= 0) {
+				fprintf(stderr, "invalid time scale\n");
+				return 1;
+			}
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		case 'S':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if (!out) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ret = load_trace(argv[optind]);
+	if (ret) {
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(-ret));
+		return 1;
+	}
+
+	if (simulate(&best, depth, time_scale, seed, &best_res)) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	fprintf(stderr, "defaults: %.1f MiB/s, read p99 %llu us\n",
+		best_res.throughput,
+		(unsigned long long)(best_res.p99_read / NSEC_PER_USEC));
+
+	// Coordinate descent over the candidate values of each tunable
+	for (u32 round = 0; round < rounds; round++) {
+		bool improved = false;
+
+		for (u32 id = 0; id < P_COUNT; id++) {
+			for (u8 v = 0; v < params[id].nr_values; v++) {
+				struct tunables cand = best;
+				struct sim_result res;
+
+				if (params[id].values[v] == param_get(&best, id))
+					continue;
+				param_set(&cand, id, params[id].values[v]);
+				if (simulate(&cand, depth, time_scale, seed, &res)) {
+					fprintf(stderr, "out of memory\n");
+					return 1;
+				}
+				if (result_better(&res, &best_res, p99_bound)) {
+					best = cand;
+					best_res = res;
+					improved = true;
+				}
+			}
+		}
+
+		fprintf(stderr, "round %u: %.1f MiB/s, read p99 %llu us\n",
+			round + 1, best_res.throughput,
+			(unsigned long long)(best_res.p99_read / NSEC_PER_USEC));
+		if (!improved)
+			break;
+	}
+
+	if (best_res.p99_read > p99_bound)
+		fprintf(stderr, "warning: no setting meets the p99 read bound\n");
+
+	print_script(out, &best, &best_res, p99_bound);
+	if (out != stdout)
+		fclose(out);
+	free(trace);
+	return 0;
+}